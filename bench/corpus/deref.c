@@ -0,0 +1,8 @@
+#include <string.h>
+
+static void fill(char *p)
+{
+	*p = "see vim: docs"[0];
+}
+
+/* vim: ts=4 */
@@ -0,0 +1,19 @@
+/* vim: set sw=8 ts=8 noet fdl=1: */
+
+struct point {
+	int x;
+	int y;
+};
+
+static int dist2(struct point a, struct point b)
+{
+	int dx = a.x - b.x, dy = a.y - b.y;
+
+	if (dx < 0) {
+		dx = -dx;
+	}
+	if (dy < 0) {
+		dy = -dy;
+	}
+	return dx * dx + dy * dy;
+}
@@ -0,0 +1,8 @@
+#!/bin/sh
+# geany: nowrap whitespace indentguides caretline
+
+set -e
+
+for f in "$@"; do
+	echo "$f"
+done
@@ -0,0 +1,9 @@
+local M = {}
+
+function M.setup(opts)
+  opts = opts or {}
+  return opts
+end
+
+return M
+-- vim: et sw=2 ts=2 wrap
@@ -0,0 +1,204 @@
+/* Generated table, large enough to be scanned from disk */
+
+static const int table_000[] = { 0, 0, 0, 0 };
+static const int table_001[] = { 1, 2, 3, 4 };
+static const int table_002[] = { 2, 4, 6, 8 };
+static const int table_003[] = { 3, 6, 9, 12 };
+static const int table_004[] = { 4, 8, 12, 16 };
+static const int table_005[] = { 5, 10, 15, 20 };
+static const int table_006[] = { 6, 12, 18, 24 };
+static const int table_007[] = { 7, 14, 21, 28 };
+static const int table_008[] = { 8, 16, 24, 32 };
+static const int table_009[] = { 9, 18, 27, 36 };
+static const int table_010[] = { 10, 20, 30, 40 };
+static const int table_011[] = { 11, 22, 33, 44 };
+static const int table_012[] = { 12, 24, 36, 48 };
+static const int table_013[] = { 13, 26, 39, 52 };
+static const int table_014[] = { 14, 28, 42, 56 };
+static const int table_015[] = { 15, 30, 45, 60 };
+static const int table_016[] = { 16, 32, 48, 64 };
+static const int table_017[] = { 17, 34, 51, 68 };
+static const int table_018[] = { 18, 36, 54, 72 };
+static const int table_019[] = { 19, 38, 57, 76 };
+static const int table_020[] = { 20, 40, 60, 80 };
+static const int table_021[] = { 21, 42, 63, 84 };
+static const int table_022[] = { 22, 44, 66, 88 };
+static const int table_023[] = { 23, 46, 69, 92 };
+static const int table_024[] = { 24, 48, 72, 96 };
+static const int table_025[] = { 25, 50, 75, 100 };
+static const int table_026[] = { 26, 52, 78, 104 };
+static const int table_027[] = { 27, 54, 81, 108 };
+static const int table_028[] = { 28, 56, 84, 112 };
+static const int table_029[] = { 29, 58, 87, 116 };
+static const int table_030[] = { 30, 60, 90, 120 };
+static const int table_031[] = { 31, 62, 93, 124 };
+static const int table_032[] = { 32, 64, 96, 128 };
+static const int table_033[] = { 33, 66, 99, 132 };
+static const int table_034[] = { 34, 68, 102, 136 };
+static const int table_035[] = { 35, 70, 105, 140 };
+static const int table_036[] = { 36, 72, 108, 144 };
+static const int table_037[] = { 37, 74, 111, 148 };
+static const int table_038[] = { 38, 76, 114, 152 };
+static const int table_039[] = { 39, 78, 117, 156 };
+static const int table_040[] = { 40, 80, 120, 160 };
+static const int table_041[] = { 41, 82, 123, 164 };
+static const int table_042[] = { 42, 84, 126, 168 };
+static const int table_043[] = { 43, 86, 129, 172 };
+static const int table_044[] = { 44, 88, 132, 176 };
+static const int table_045[] = { 45, 90, 135, 180 };
+static const int table_046[] = { 46, 92, 138, 184 };
+static const int table_047[] = { 47, 94, 141, 188 };
+static const int table_048[] = { 48, 96, 144, 192 };
+static const int table_049[] = { 49, 98, 147, 196 };
+static const int table_050[] = { 50, 100, 150, 200 };
+static const int table_051[] = { 51, 102, 153, 204 };
+static const int table_052[] = { 52, 104, 156, 208 };
+static const int table_053[] = { 53, 106, 159, 212 };
+static const int table_054[] = { 54, 108, 162, 216 };
+static const int table_055[] = { 55, 110, 165, 220 };
+static const int table_056[] = { 56, 112, 168, 224 };
+static const int table_057[] = { 57, 114, 171, 228 };
+static const int table_058[] = { 58, 116, 174, 232 };
+static const int table_059[] = { 59, 118, 177, 236 };
+static const int table_060[] = { 60, 120, 180, 240 };
+static const int table_061[] = { 61, 122, 183, 244 };
+static const int table_062[] = { 62, 124, 186, 248 };
+static const int table_063[] = { 63, 126, 189, 252 };
+static const int table_064[] = { 64, 128, 192, 256 };
+static const int table_065[] = { 65, 130, 195, 260 };
+static const int table_066[] = { 66, 132, 198, 264 };
+static const int table_067[] = { 67, 134, 201, 268 };
+static const int table_068[] = { 68, 136, 204, 272 };
+static const int table_069[] = { 69, 138, 207, 276 };
+static const int table_070[] = { 70, 140, 210, 280 };
+static const int table_071[] = { 71, 142, 213, 284 };
+static const int table_072[] = { 72, 144, 216, 288 };
+static const int table_073[] = { 73, 146, 219, 292 };
+static const int table_074[] = { 74, 148, 222, 296 };
+static const int table_075[] = { 75, 150, 225, 300 };
+static const int table_076[] = { 76, 152, 228, 304 };
+static const int table_077[] = { 77, 154, 231, 308 };
+static const int table_078[] = { 78, 156, 234, 312 };
+static const int table_079[] = { 79, 158, 237, 316 };
+static const int table_080[] = { 80, 160, 240, 320 };
+static const int table_081[] = { 81, 162, 243, 324 };
+static const int table_082[] = { 82, 164, 246, 328 };
+static const int table_083[] = { 83, 166, 249, 332 };
+static const int table_084[] = { 84, 168, 252, 336 };
+static const int table_085[] = { 85, 170, 255, 340 };
+static const int table_086[] = { 86, 172, 258, 344 };
+static const int table_087[] = { 87, 174, 261, 348 };
+static const int table_088[] = { 88, 176, 264, 352 };
+static const int table_089[] = { 89, 178, 267, 356 };
+static const int table_090[] = { 90, 180, 270, 360 };
+static const int table_091[] = { 91, 182, 273, 364 };
+static const int table_092[] = { 92, 184, 276, 368 };
+static const int table_093[] = { 93, 186, 279, 372 };
+static const int table_094[] = { 94, 188, 282, 376 };
+static const int table_095[] = { 95, 190, 285, 380 };
+static const int table_096[] = { 96, 192, 288, 384 };
+static const int table_097[] = { 97, 194, 291, 388 };
+static const int table_098[] = { 98, 196, 294, 392 };
+static const int table_099[] = { 99, 198, 297, 396 };
+static const int table_100[] = { 100, 200, 300, 400 };
+static const int table_101[] = { 101, 202, 303, 404 };
+static const int table_102[] = { 102, 204, 306, 408 };
+static const int table_103[] = { 103, 206, 309, 412 };
+static const int table_104[] = { 104, 208, 312, 416 };
+static const int table_105[] = { 105, 210, 315, 420 };
+static const int table_106[] = { 106, 212, 318, 424 };
+static const int table_107[] = { 107, 214, 321, 428 };
+static const int table_108[] = { 108, 216, 324, 432 };
+static const int table_109[] = { 109, 218, 327, 436 };
+static const int table_110[] = { 110, 220, 330, 440 };
+static const int table_111[] = { 111, 222, 333, 444 };
+static const int table_112[] = { 112, 224, 336, 448 };
+static const int table_113[] = { 113, 226, 339, 452 };
+static const int table_114[] = { 114, 228, 342, 456 };
+static const int table_115[] = { 115, 230, 345, 460 };
+static const int table_116[] = { 116, 232, 348, 464 };
+static const int table_117[] = { 117, 234, 351, 468 };
+static const int table_118[] = { 118, 236, 354, 472 };
+static const int table_119[] = { 119, 238, 357, 476 };
+static const int table_120[] = { 120, 240, 360, 480 };
+static const int table_121[] = { 121, 242, 363, 484 };
+static const int table_122[] = { 122, 244, 366, 488 };
+static const int table_123[] = { 123, 246, 369, 492 };
+static const int table_124[] = { 124, 248, 372, 496 };
+static const int table_125[] = { 125, 250, 375, 500 };
+static const int table_126[] = { 126, 252, 378, 504 };
+static const int table_127[] = { 127, 254, 381, 508 };
+static const int table_128[] = { 128, 256, 384, 512 };
+static const int table_129[] = { 129, 258, 387, 516 };
+static const int table_130[] = { 130, 260, 390, 520 };
+static const int table_131[] = { 131, 262, 393, 524 };
+static const int table_132[] = { 132, 264, 396, 528 };
+static const int table_133[] = { 133, 266, 399, 532 };
+static const int table_134[] = { 134, 268, 402, 536 };
+static const int table_135[] = { 135, 270, 405, 540 };
+static const int table_136[] = { 136, 272, 408, 544 };
+static const int table_137[] = { 137, 274, 411, 548 };
+static const int table_138[] = { 138, 276, 414, 552 };
+static const int table_139[] = { 139, 278, 417, 556 };
+static const int table_140[] = { 140, 280, 420, 560 };
+static const int table_141[] = { 141, 282, 423, 564 };
+static const int table_142[] = { 142, 284, 426, 568 };
+static const int table_143[] = { 143, 286, 429, 572 };
+static const int table_144[] = { 144, 288, 432, 576 };
+static const int table_145[] = { 145, 290, 435, 580 };
+static const int table_146[] = { 146, 292, 438, 584 };
+static const int table_147[] = { 147, 294, 441, 588 };
+static const int table_148[] = { 148, 296, 444, 592 };
+static const int table_149[] = { 149, 298, 447, 596 };
+static const int table_150[] = { 150, 300, 450, 600 };
+static const int table_151[] = { 151, 302, 453, 604 };
+static const int table_152[] = { 152, 304, 456, 608 };
+static const int table_153[] = { 153, 306, 459, 612 };
+static const int table_154[] = { 154, 308, 462, 616 };
+static const int table_155[] = { 155, 310, 465, 620 };
+static const int table_156[] = { 156, 312, 468, 624 };
+static const int table_157[] = { 157, 314, 471, 628 };
+static const int table_158[] = { 158, 316, 474, 632 };
+static const int table_159[] = { 159, 318, 477, 636 };
+static const int table_160[] = { 160, 320, 480, 640 };
+static const int table_161[] = { 161, 322, 483, 644 };
+static const int table_162[] = { 162, 324, 486, 648 };
+static const int table_163[] = { 163, 326, 489, 652 };
+static const int table_164[] = { 164, 328, 492, 656 };
+static const int table_165[] = { 165, 330, 495, 660 };
+static const int table_166[] = { 166, 332, 498, 664 };
+static const int table_167[] = { 167, 334, 501, 668 };
+static const int table_168[] = { 168, 336, 504, 672 };
+static const int table_169[] = { 169, 338, 507, 676 };
+static const int table_170[] = { 170, 340, 510, 680 };
+static const int table_171[] = { 171, 342, 513, 684 };
+static const int table_172[] = { 172, 344, 516, 688 };
+static const int table_173[] = { 173, 346, 519, 692 };
+static const int table_174[] = { 174, 348, 522, 696 };
+static const int table_175[] = { 175, 350, 525, 700 };
+static const int table_176[] = { 176, 352, 528, 704 };
+static const int table_177[] = { 177, 354, 531, 708 };
+static const int table_178[] = { 178, 356, 534, 712 };
+static const int table_179[] = { 179, 358, 537, 716 };
+static const int table_180[] = { 180, 360, 540, 720 };
+static const int table_181[] = { 181, 362, 543, 724 };
+static const int table_182[] = { 182, 364, 546, 728 };
+static const int table_183[] = { 183, 366, 549, 732 };
+static const int table_184[] = { 184, 368, 552, 736 };
+static const int table_185[] = { 185, 370, 555, 740 };
+static const int table_186[] = { 186, 372, 558, 744 };
+static const int table_187[] = { 187, 374, 561, 748 };
+static const int table_188[] = { 188, 376, 564, 752 };
+static const int table_189[] = { 189, 378, 567, 756 };
+static const int table_190[] = { 190, 380, 570, 760 };
+static const int table_191[] = { 191, 382, 573, 764 };
+static const int table_192[] = { 192, 384, 576, 768 };
+static const int table_193[] = { 193, 386, 579, 772 };
+static const int table_194[] = { 194, 388, 582, 776 };
+static const int table_195[] = { 195, 390, 585, 780 };
+static const int table_196[] = { 196, 392, 588, 784 };
+static const int table_197[] = { 197, 394, 591, 788 };
+static const int table_198[] = { 198, 396, 594, 792 };
+static const int table_199[] = { 199, 398, 597, 796 };
+
+/* vim: set ts=8 sw=8 noet nowrap: */
@@ -0,0 +1,11 @@
+CC ?= gcc
+
+all: prog
+
+prog: prog.o
+	$(CC) -o $@ $^
+
+clean:
+	rm -f prog prog.o
+
+# vim: noet ts=8 sw=8
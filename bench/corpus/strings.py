@@ -0,0 +1,8 @@
+TIPS = [
+    "set the tab width in a modeline",
+"see vim: ts=3 et",
+]
+
+
+def tips():
+    return list(TIPS)
@@ -0,0 +1,18 @@
+/* vim: set ts=4 sw=4 et: */
+
+#include <stdio.h>
+
+static int square(int x)
+{
+    return x * x;
+}
+
+int main(void)
+{
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        printf("%d\n", square(i));
+    }
+    return 0;
+}
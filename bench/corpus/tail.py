@@ -0,0 +1,12 @@
+import sys
+
+
+def main(args):
+    for arg in args:
+        print(arg)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
+
+# vim: ts=4 sw=4 et ft=python
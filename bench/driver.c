@@ -0,0 +1,543 @@
+// vim: expandtab:ts=8:encoding=UTF-8
+
+/*
+ * Headless driver: runs the plugin against the mock Geany of mock.c, with
+ * no display and no Geany.  Each round opens the given files, saves them,
+ * edits their first line, puts their indentation and wrapping back to the
+ * preferences as a user could from the menus and applies modelines to all
+ * of them from the Tools menu, then closes them.  The main loop runs after each step until
+ * the plugin's scans are done, and the time until its last dispatch is
+ * reported per step.
+ *
+ *   driver [-c] [-e EXPECT] [-l BYTES] [-n ROUNDS] [-t TRACE] FILE...
+ *   driver [-c] [-l BYTES] [-t TRACE] -r TRACE
+ *
+ * With -c, the editor calls the mock saw are checked against the plugin's
+ * own counters: every call has to go through one of the plugin's counted
+ * wrappers, and a scan may read no more than the lines of its windows.
+ *
+ * With -e, each document is checked after it was saved and after Apply
+ * Modelines to All Documents against the group of EXPECT named after the
+ * file, see bench/corpus.conf.
+ *
+ * With -t, the plugin's trace (trace=true) is written to TRACE.  With -r,
+ * the opens and saves of a trace are replayed instead of the rounds, and
+ * the time each kind of event took in the trace and in the replay is
+ * reported.
+ *
+ * The plugin writes its debug output to stdout; the report goes to stderr.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "mock.h"
+
+#define DRIVER_QUIET 20 /**< ms without a dispatch after which the plugin is idle */
+#define DRIVER_LIVE_QUIET 1000 /**< ms to wait out the plugin's live re-scan delay */
+#define DRIVER_SCAN_LINES 50 /**< ML_SCAN_LINES of the plugin */
+
+/**
+ * @brief Steps of a round
+ */
+enum driver_step {
+        DRIVER_OPEN, /**< Open each file */
+        DRIVER_SAVE, /**< Save each document */
+        DRIVER_EDIT, /**< Type into and restore each first line */
+        DRIVER_APPLY_ALL, /**< Tools > Apply Modelines to All Documents */
+        DRIVER_CLOSE, /**< Close each document */
+        DRIVER_N_STEPS
+};
+
+static const gchar *const step_names[] = { "open", "save", "edit", "apply-all", "close" };
+
+/**< Time spent in each step, in us */
+static gint64 step_usec[DRIVER_N_STEPS];
+
+/**< Replayed events per step, DRIVER_OPEN and DRIVER_SAVE */
+static guint replay_events[DRIVER_N_STEPS];
+
+/**< Time the replayed events took in the trace, in us */
+static gint64 traced_usec[DRIVER_N_STEPS];
+
+/**< Expected settings per file name, if opt_expect */
+static GKeyFile *expect;
+
+/**< All expected settings were found */
+static gboolean expect_ok = TRUE;
+
+static gboolean opt_check;
+static gchar *opt_expect;
+static gint64 opt_large_file_size = -1;
+static gint opt_rounds = 1;
+static gchar *opt_trace;
+static gchar *opt_replay;
+
+static GOptionEntry entries[] = {
+        { "check", 'c', 0, G_OPTION_ARG_NONE, &opt_check,
+          "Check the editor calls against the plugin's counters", NULL },
+        { "expect", 'e', 0, G_OPTION_ARG_FILENAME, &opt_expect,
+          "Check the documents against the settings in EXPECT", "EXPECT" },
+        { "large-file-size", 'l', 0, G_OPTION_ARG_INT64, &opt_large_file_size,
+          "large_file_size of the plugin", "BYTES" },
+        { "rounds", 'n', 0, G_OPTION_ARG_INT, &opt_rounds,
+          "Rounds over the files", "N" },
+        { "trace", 't', 0, G_OPTION_ARG_FILENAME, &opt_trace,
+          "Write the plugin's trace to TRACE", "TRACE" },
+        { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &opt_replay,
+          "Replay the opens and saves of TRACE instead of the rounds", "TRACE" },
+        { NULL }
+};
+
+/**
+ * @brief Timer: the plugin was quiet long enough.
+ */
+static gboolean quiet_done(gpointer data)
+{
+        *(gboolean *) data = TRUE;
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Run the main loop until nothing was dispatched for a while.
+ *        Background reads finish by dispatching on the main loop, so the
+ *        plugin is done when it stays quiet.
+ *
+ * @param start g_get_monotonic_time() when the step started
+ * @param quiet ms without a dispatch to wait for
+ *
+ * @return Time from start to the plugin's last dispatch, in us
+ */
+static gint64 drain(gint64 start, guint quiet)
+{
+        gint64 end = g_get_monotonic_time();
+        gboolean done;
+        guint source;
+
+        for (;;) {
+                while (g_main_context_iteration(NULL, FALSE))
+                        end = g_get_monotonic_time();
+
+                done = FALSE;
+                source = g_timeout_add(quiet, quiet_done, &done);
+                g_main_context_iteration(NULL, TRUE);
+                if (done)
+                        break;
+                g_source_remove(source);
+                end = g_get_monotonic_time();
+        }
+
+        return end - start;
+}
+
+/**
+ * @brief Compare one expected setting, if EXPECT has it.
+ *
+ * @param group File name
+ * @param key Setting
+ * @param value What the document is set to, NULL if nothing
+ * @param when Step the documents were checked after
+ */
+static void expect_string(const gchar *group, const gchar *key, const gchar *value,
+                          const gchar *when)
+{
+        gchar *want;
+
+        if (!(want = g_key_file_get_string(expect, group, key, NULL)))
+                return;
+
+        if (!value || g_ascii_strcasecmp(want, value)) {
+                g_printerr("check: %s after %s: %s is %s, expected %s\n",
+                           group, when, key, value ? value : "unset", want);
+                expect_ok = FALSE;
+        }
+        g_free(want);
+}
+
+/**
+ * @brief Compare the documents with the settings EXPECT has for their files.
+ *
+ * @param docs Documents
+ * @param when Step the documents were checked after
+ */
+static void expect_check(GPtrArray *docs, const gchar *when)
+{
+        static const gchar *const eol_names[] = { "crlf", "cr", "lf" };
+        struct mock_settings set;
+        GeanyDocument *doc;
+        gchar *group, num[16];
+        guint i;
+
+        if (!expect)
+                return;
+
+        for (i = 0; i < docs->len; i++) {
+                doc = g_ptr_array_index(docs, i);
+                group = g_path_get_basename(doc->file_name);
+                if (g_key_file_has_group(expect, group)) {
+                        mock_document_settings(doc, &set);
+                        g_snprintf(num, sizeof(num), "%d", set.indent_width);
+
+                        expect_string(group, "filetype", set.filetype, when);
+                        expect_string(group, "encoding", set.encoding, when);
+                        expect_string(group, "indent_width", num, when);
+                        expect_string(group, "expand_tab", set.expand_tab ? "true" : "false", when);
+                        expect_string(group, "wrap", set.wrap ? "true" : "false", when);
+                        expect_string(group, "eol", eol_names[set.eol_mode], when);
+                        expect_string(group, "readonly", set.readonly ? "true" : "false", when);
+                }
+                g_free(group);
+        }
+}
+
+/**
+ * @brief One round over the files.
+ *
+ * @param files Files
+ */
+static void run_round(gchar **files)
+{
+        GPtrArray *docs;
+        GeanyDocument *doc;
+        gint64 start;
+        guint i;
+
+        docs = g_ptr_array_new();
+
+        for (i = 0; files[i]; i++) {
+                start = g_get_monotonic_time();
+                doc = mock_document_open(files[i]);
+                step_usec[DRIVER_OPEN] += drain(start, DRIVER_QUIET);
+                if (doc)
+                        g_ptr_array_add(docs, doc);
+                else
+                        g_printerr("driver: cannot open %s\n", files[i]);
+        }
+
+        for (i = 0; i < docs->len; i++) {
+                start = g_get_monotonic_time();
+                mock_document_save(g_ptr_array_index(docs, i));
+                step_usec[DRIVER_SAVE] += drain(start, DRIVER_QUIET);
+        }
+        expect_check(docs, "save");
+
+        // One wait for the live re-scans of all documents
+        start = g_get_monotonic_time();
+        for (i = 0; i < docs->len; i++) {
+                doc = g_ptr_array_index(docs, i);
+                mock_insert_text(doc, 0, " ");
+                mock_delete_text(doc, 0, 1);
+        }
+        step_usec[DRIVER_EDIT] += drain(start, DRIVER_LIVE_QUIET);
+
+        // Applying to all has to override what the user chose since
+        for (i = 0; i < docs->len; i++)
+                mock_document_reset(g_ptr_array_index(docs, i));
+
+        start = g_get_monotonic_time();
+        mock_apply_all();
+        step_usec[DRIVER_APPLY_ALL] += drain(start, DRIVER_QUIET);
+        expect_check(docs, "apply-all");
+
+        for (i = 0; i < docs->len; i++) {
+                start = g_get_monotonic_time();
+                mock_document_close(g_ptr_array_index(docs, i));
+                step_usec[DRIVER_CLOSE] += drain(start, DRIVER_QUIET);
+        }
+
+        g_ptr_array_free(docs, TRUE);
+}
+
+/**
+ * @brief Replay a trace the plugin wrote.  Closes are not traced, so a
+ *        document opened again is closed first, and one saved without
+ *        being open is opened first; neither is timed.
+ *
+ * @param trace Trace file
+ *
+ * @return FALSE if the trace cannot be read
+ */
+static gboolean replay(const gchar *trace)
+{
+        GHashTable *paths;
+        GHashTableIter iter;
+        GeanyDocument *doc;
+        GError *err = NULL;
+        gchar *contents, **lines, **cols, *path;
+        enum driver_step step;
+        gint64 start;
+        guint i;
+
+        if (!g_file_get_contents(trace, &contents, NULL, &err)) {
+                g_printerr("driver: %s\n", err->message);
+                g_error_free(err);
+                return FALSE;
+        }
+
+        paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        lines = g_strsplit(contents, "\n", -1);
+
+        for (i = 0; lines[i]; i++) {
+                cols = g_strsplit(lines[i], "\t", 5);
+                if (g_strv_length(cols) != 5 || !*cols[4]) {
+                        // Blank line, or a document never saved
+                        g_strfreev(cols);
+                        continue;
+                }
+
+                if (!strcmp(cols[0], "open"))
+                        step = DRIVER_OPEN;
+                else if (!strcmp(cols[0], "save"))
+                        step = DRIVER_SAVE;
+                else {
+                        g_strfreev(cols);
+                        continue;
+                }
+
+                path = g_strcompress(cols[4]);
+                doc = mock_document_find(path);
+                if (doc && step == DRIVER_OPEN) {
+                        mock_document_close(doc);
+                        drain(g_get_monotonic_time(), DRIVER_QUIET);
+                        doc = NULL;
+                } else if (!doc && step == DRIVER_SAVE) {
+                        doc = mock_document_open(path);
+                        drain(g_get_monotonic_time(), DRIVER_QUIET);
+                }
+
+                start = g_get_monotonic_time();
+                if (step == DRIVER_OPEN)
+                        doc = mock_document_open(path);
+                else if (doc)
+                        mock_document_save(doc);
+
+                if (doc) {
+                        step_usec[step] += drain(start, DRIVER_QUIET);
+                        traced_usec[step] += g_ascii_strtoll(cols[2], NULL, 10);
+                        replay_events[step]++;
+                        g_hash_table_add(paths, path);
+                } else {
+                        g_printerr("driver: cannot open %s\n", path);
+                        g_free(path);
+                }
+                g_strfreev(cols);
+        }
+
+        g_hash_table_iter_init(&iter, paths);
+        while (g_hash_table_iter_next(&iter, (gpointer *) &path, NULL)) {
+                if ((doc = mock_document_find(path))) {
+                        start = g_get_monotonic_time();
+                        mock_document_close(doc);
+                        step_usec[DRIVER_CLOSE] += drain(start, DRIVER_QUIET);
+                }
+        }
+
+        g_hash_table_destroy(paths);
+        g_strfreev(lines);
+        g_free(contents);
+        return TRUE;
+}
+
+/**
+ * @brief Write the plugin configuration.
+ *
+ * @param configdir Configuration directory
+ */
+static void write_config(const gchar *configdir)
+{
+        gchar *dir, *path;
+        GString *conf;
+
+        dir = g_build_filename(configdir, "plugins", "modeline", NULL);
+        g_mkdir_with_parents(dir, 0700);
+        path = g_build_filename(dir, "modeline.conf", NULL);
+        conf = g_string_new("[modeline]\n");
+        if (opt_large_file_size >= 0)
+                g_string_append_printf(conf, "large_file_size=%" G_GINT64_FORMAT "\n",
+                                       opt_large_file_size);
+        if (opt_trace)
+                g_string_append(conf, "trace=true\n");
+        g_file_set_contents(path, conf->str, -1, NULL);
+
+        g_string_free(conf, TRUE);
+        g_free(path);
+        g_free(dir);
+}
+
+/**
+ * @brief Delete a directory tree.
+ *
+ * @param path Directory
+ */
+static void remove_tree(const gchar *path)
+{
+        const gchar *name;
+        gchar *child;
+        GDir *dir;
+
+        if ((dir = g_dir_open(path, 0, NULL))) {
+                while ((name = g_dir_read_name(dir))) {
+                        child = g_build_filename(path, name, NULL);
+                        if (g_file_test(child, G_FILE_TEST_IS_DIR))
+                                remove_tree(child);
+                        else
+                                g_unlink(child);
+                        g_free(child);
+                }
+                g_dir_close(dir);
+        }
+        g_rmdir(path);
+}
+
+/**
+ * @brief Compare the editor calls the mock saw with the plugin's counters.
+ *
+ * @param kf Counters file the plugin wrote on unload
+ *
+ * @return TRUE if they agree
+ */
+static gboolean check_calls(GKeyFile *kf)
+{
+        guint64 counted, scanned;
+        gboolean ok = TRUE;
+        guint i;
+
+        for (i = 0; i < MOCK_N_CALLS; i++) {
+                counted = g_key_file_get_uint64(kf, "counters", mock_call_keys[i], NULL);
+                if (counted != mock_calls[i]) {
+                        g_printerr("check: %s: the plugin counted %" G_GUINT64_FORMAT
+                                   ", the editor saw %" G_GUINT64_FORMAT "\n",
+                                   mock_call_keys[i], counted, mock_calls[i]);
+                        ok = FALSE;
+                }
+        }
+
+        // Each scan reads the line count and at most both windows
+        scanned = g_key_file_get_uint64(kf, "counters", "documents_scanned", NULL);
+        if (mock_calls[MOCK_SCI_LINES] > scanned * (2 * DRIVER_SCAN_LINES + 1)) {
+                g_printerr("check: %" G_GUINT64_FORMAT " line reads for %" G_GUINT64_FORMAT
+                           " scans\n", mock_calls[MOCK_SCI_LINES], scanned);
+                ok = FALSE;
+        }
+
+        return ok;
+}
+
+/**
+ * @brief Print what the rounds took.
+ *
+ * @param kf Counters file the plugin wrote on unload
+ */
+static void report(GKeyFile *kf)
+{
+        gchar **keys;
+        guint i;
+
+        for (i = 0; i < DRIVER_N_STEPS; i++)
+                g_printerr("%-10s %10" G_GINT64_FORMAT " us\n", step_names[i], step_usec[i]);
+
+        if (opt_replay) {
+                for (i = 0; i < DRIVER_N_STEPS; i++) {
+                        if (replay_events[i])
+                                g_printerr("%-10s %6u events, %10" G_GINT64_FORMAT
+                                           " us traced, %10" G_GINT64_FORMAT " us replayed\n",
+                                           step_names[i], replay_events[i], traced_usec[i],
+                                           step_usec[i]);
+                }
+        }
+
+        if ((keys = g_key_file_get_keys(kf, "counters", NULL, NULL))) {
+                for (i = 0; keys[i]; i++)
+                        g_printerr("%-20s %12" G_GUINT64_FORMAT "\n", keys[i],
+                                   g_key_file_get_uint64(kf, "counters", keys[i], NULL));
+                g_strfreev(keys);
+        }
+}
+
+int main(int argc, char **argv)
+{
+        GOptionContext *ctx;
+        GError *err = NULL;
+        GKeyFile *kf;
+        gchar *tmp, *configdir, *cachedir, *path, *trace = NULL;
+        gboolean ok = TRUE;
+        gsize len;
+        gint round;
+
+        ctx = g_option_context_new("FILE... - put files through the modeline plugin");
+        g_option_context_add_main_entries(ctx, entries, NULL);
+        if (!g_option_context_parse(ctx, &argc, &argv, &err) || (argc < 2 && !opt_replay)) {
+                g_printerr("driver: %s\n", err ? err->message : "no files given");
+                return 2;
+        }
+        g_option_context_free(ctx);
+
+        if (opt_expect) {
+                expect = g_key_file_new();
+                if (!g_key_file_load_from_file(expect, opt_expect, G_KEY_FILE_NONE, &err)) {
+                        g_printerr("driver: %s: %s\n", opt_expect, err->message);
+                        return 2;
+                }
+        }
+
+        // A scratch configuration and cache, so earlier counters do not count
+        if (!(tmp = g_dir_make_tmp("modeline-driver-XXXXXX", &err))) {
+                g_printerr("driver: %s\n", err->message);
+                return 2;
+        }
+        configdir = g_build_filename(tmp, "config", NULL);
+        cachedir = g_build_filename(tmp, "cache", NULL);
+        g_setenv("XDG_CACHE_HOME", cachedir, TRUE);
+        write_config(configdir);
+
+        mock_init(configdir);
+        mock_plugin_load();
+        drain(g_get_monotonic_time(), DRIVER_QUIET);
+
+        if (opt_replay)
+                ok = replay(opt_replay);
+        else {
+                for (round = 0; round < opt_rounds; round++)
+                        run_round(argv + 1);
+        }
+
+        mock_plugin_unload();
+
+        if (opt_trace) {
+                path = g_build_filename(cachedir, "geany", "modeline", "trace", NULL);
+                if (!g_file_get_contents(path, &trace, &len, &err) ||
+                    !g_file_set_contents(opt_trace, trace, len, &err)) {
+                        g_printerr("driver: %s\n", err->message);
+                        ok = FALSE;
+                }
+                g_free(trace);
+                g_free(path);
+        }
+
+        if (!ok) {
+                remove_tree(tmp);
+                return 2;
+        }
+
+        kf = g_key_file_new();
+        path = g_build_filename(cachedir, "geany", "modeline", "counters", NULL);
+        if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &err)) {
+                g_printerr("driver: %s: %s\n", path, err->message);
+                return 2;
+        }
+
+        report(kf);
+        if (opt_check)
+                ok = check_calls(kf);
+        ok = ok && expect_ok;
+
+        g_key_file_free(kf);
+        g_free(path);
+        remove_tree(tmp);
+        g_free(cachedir);
+        g_free(configdir);
+        g_free(tmp);
+
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+// vim: expandtab:ts=8:encoding=UTF-8
+
+/*
+ * Stand-in for Geany's plugin header, used to build modeline.c into the
+ * headless driver.  It declares the part of Geany's plugin API and of
+ * Scintilla that the plugin uses, with the same names and values, and
+ * mock.c implements it.  Only GLib and GIO are needed.
+ */
+
+#ifndef ML_BENCH_GEANYPLUGIN_H
+#define ML_BENCH_GEANYPLUGIN_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define _(String) (String)
+
+/* Scintilla */
+
+typedef guintptr uptr_t;
+typedef gintptr sptr_t;
+
+/** ScintillaObject, see mock.c */
+typedef struct ScintillaObject ScintillaObject;
+
+/**
+ * @brief Notification header
+ */
+struct Sci_NotifyHeader {
+        void *hwndFrom; /**< Editor */
+        uptr_t idFrom; /**< */
+        unsigned int code; /**< SCN_ code */
+};
+
+/**
+ * @brief Scintilla notification, the fields the plugin reads
+ */
+typedef struct SCNotification {
+        struct Sci_NotifyHeader nmhdr; /**< */
+        sptr_t position; /**< SCN_MODIFIED: start of the change */
+        int modificationType; /**< SCN_MODIFIED: SC_MOD_ flags */
+        const char *text; /**< SCN_MODIFIED: inserted text */
+        sptr_t length; /**< SCN_MODIFIED: length of the change */
+        sptr_t linesAdded; /**< SCN_MODIFIED: lines added, negative if removed */
+} SCNotification;
+
+#define SCI_CLEARDOCUMENTSTYLE 2005
+#define SCI_GETLENGTH 2006
+#define SCI_GETCURRENTPOS 2008
+#define SCI_SETUNDOCOLLECTION 2012
+#define SCI_SETSAVEPOINT 2014
+#define SCI_SETVIEWWS 2021
+#define SCWS_INVISIBLE 0
+#define SCWS_VISIBLEALWAYS 1
+#define SCI_GETENDSTYLED 2028
+#define SCI_CONVERTEOLS 2029
+#define SCI_GETEOLMODE 2030
+#define SCI_SETEOLMODE 2031
+#define SC_EOL_CRLF 0
+#define SC_EOL_CR 1
+#define SC_EOL_LF 2
+#define SCI_BEGINUNDOACTION 2078
+#define SCI_ENDUNDOACTION 2079
+#define SCI_SETCARETLINEVISIBLE 2096
+#define SCI_SETINDENTATIONGUIDES 2132
+#define SC_IV_NONE 0
+#define SC_IV_LOOKBOTH 3
+#define SCI_GETREADONLY 2140
+#define SCI_GETLINECOUNT 2154
+#define SCI_LINEFROMPOSITION 2166
+#define SCI_POSITIONFROMLINE 2167
+#define SCI_SETREADONLY 2171
+#define SCI_EMPTYUNDOBUFFER 2175
+#define SCI_SETTEXT 2181
+#define SCI_GETFOLDLEVEL 2223
+#define SC_FOLDLEVELBASE 0x400
+#define SC_FOLDLEVELHEADERFLAG 0x2000
+#define SC_FOLDLEVELNUMBERMASK 0x0FFF
+#define SCI_GETLASTCHILD 2224
+#define SCI_FOLDLINE 2237
+#define SC_FOLDACTION_CONTRACT 0
+#define SC_FOLDACTION_EXPAND 1
+#define SCI_SETMARGINWIDTHN 2242
+#define SCI_SETWRAPMODE 2268
+#define SC_WRAP_NONE 0
+#define SC_WRAP_WORD 1
+#define SCI_SETLAYOUTCACHE 2272
+#define SC_CACHE_NONE 0
+#define SC_CACHE_CARET 1
+#define SC_CACHE_PAGE 2
+#define SC_CACHE_DOCUMENT 3
+#define SCI_SETPOSITIONCACHE 2514
+#define SCI_GETCHARACTERPOINTER 2520
+#define SCI_FOLDALL 2662
+#define SCI_SETIDLESTYLING 2692
+#define SC_IDLESTYLING_NONE 0
+#define SC_IDLESTYLING_TOVISIBLE 1
+#define SC_IDLESTYLING_AFTERVISIBLE 2
+#define SC_IDLESTYLING_ALL 3
+#define SCI_SETLAYOUTTHREADS 2775
+#define SCI_SETPROPERTY 4004
+#define SCI_GETPROPERTYINT 4010
+#define SCN_MODIFIED 2008
+#define SCN_PAINTED 2013
+#define SC_MOD_INSERTTEXT 0x1
+#define SC_MOD_DELETETEXT 0x2
+
+sptr_t scintilla_send_message(ScintillaObject *sci, unsigned int msg, uptr_t wparam, sptr_t lparam);
+
+/* GTK, the tools menu item only */
+
+/** Plain GObject with an "activate" signal, see mock.c */
+typedef GObject GtkWidget;
+
+#define GTK_CONTAINER(obj) ((gpointer) (obj))
+
+GtkWidget *gtk_menu_item_new_with_mnemonic(const gchar *label);
+void gtk_widget_show(GtkWidget *widget);
+void gtk_widget_destroy(GtkWidget *widget);
+void gtk_container_add(gpointer container, GtkWidget *widget);
+
+/* Geany */
+
+#define GEANY_API_VERSION 225
+#define GEANY_ABI_VERSION 73
+#define GEANY_FILETYPES_NONE 0
+
+typedef enum {
+        GEANY_INDENT_TYPE_SPACES,
+        GEANY_INDENT_TYPE_TABS,
+        GEANY_INDENT_TYPE_BOTH
+} GeanyIndentType;
+
+/**
+ * @brief Indentation settings of an editor
+ */
+typedef struct GeanyIndentPrefs {
+        gint width; /**< Indent width */
+        GeanyIndentType type; /**< Tabs, spaces or both */
+        gint hard_tab_width; /**< Width of a tab */
+} GeanyIndentPrefs;
+
+/**
+ * @brief Filetype
+ */
+typedef struct GeanyFiletype {
+        gint id; /**< Index in filetypes_array */
+        gchar *name; /**< Name, e.g. "C" */
+        gchar *title; /**< Display name */
+        gchar **pattern; /**< File name globs */
+        gchar *comment_single; /**< Line comment */
+        gchar *comment_open; /**< Block comment start */
+        gchar *comment_close; /**< Block comment end */
+} GeanyFiletype;
+
+struct GeanyDocument;
+
+/**
+ * @brief Editor of a document
+ */
+typedef struct GeanyEditor {
+        struct GeanyDocument *document; /**< Document */
+        ScintillaObject *sci; /**< Scintilla widget */
+        gboolean line_wrapping; /**< Lines are wrapped */
+        gboolean auto_indent; /**< */
+        gfloat scroll_percent; /**< */
+} GeanyEditor;
+
+/**
+ * @brief Open document
+ */
+typedef struct GeanyDocument {
+        gboolean is_valid; /**< Slot holds an open document */
+        gint index; /**< Index in documents_array */
+        gboolean has_tags; /**< */
+        gchar *file_name; /**< UTF-8 file name */
+        gchar *encoding; /**< Charset of the file */
+        gboolean has_bom; /**< File started with a BOM */
+        GeanyEditor *editor; /**< Editor */
+        GeanyFiletype *file_type; /**< Filetype */
+        gpointer tm_file; /**< */
+        gboolean readonly; /**< */
+        gboolean changed; /**< Unsaved changes */
+        gchar *real_path; /**< Locale encoded real path, NULL if not on disk */
+        guint id; /**< Unique id */
+        gpointer priv; /**< */
+} GeanyDocument;
+
+/**
+ * @brief Application paths
+ */
+typedef struct GeanyApp {
+        gboolean debug_mode; /**< */
+        gchar *configdir; /**< Configuration directory */
+        gchar *datadir; /**< */
+        gchar *docdir; /**< */
+        gpointer tm_workspace; /**< */
+        gpointer project; /**< */
+} GeanyApp;
+
+/**
+ * @brief Main window widgets
+ */
+typedef struct GeanyMainWidgets {
+        GtkWidget *window; /**< */
+        GtkWidget *toolbar; /**< */
+        GtkWidget *sidebar_notebook; /**< */
+        GtkWidget *notebook; /**< */
+        GtkWidget *editor_menu; /**< */
+        GtkWidget *tools_menu; /**< Tools menu */
+        GtkWidget *progressbar; /**< */
+        GtkWidget *message_window_notebook; /**< */
+        GtkWidget *project_menu; /**< */
+} GeanyMainWidgets;
+
+/**
+ * @brief Editor preferences
+ */
+typedef struct GeanyEditorPrefs {
+        GeanyIndentPrefs *indentation; /**< Default indentation */
+        gboolean show_white_space; /**< */
+        gboolean show_indent_guide; /**< */
+        gboolean show_line_endings; /**< */
+        gint long_line_type; /**< */
+        gint long_line_column; /**< */
+        gchar *long_line_color; /**< */
+        gboolean show_markers_margin; /**< */
+        gboolean show_linenumber_margin; /**< */
+        gboolean show_scrollbars; /**< */
+        gboolean scroll_stop_at_last_line; /**< */
+        gboolean line_wrapping; /**< */
+        gboolean use_indicators; /**< */
+        gboolean folding; /**< Code folding is enabled */
+} GeanyEditorPrefs;
+
+/**
+ * @brief What Geany shares with plugins
+ */
+typedef struct GeanyData {
+        GeanyApp *app; /**< */
+        GeanyMainWidgets *main_widgets; /**< */
+        GPtrArray *documents_array; /**< GeanyDocument, one per slot */
+        GPtrArray *filetypes_array; /**< GeanyFiletype, by id */
+        gpointer prefs; /**< */
+        gpointer interface_prefs; /**< */
+        gpointer toolbar_prefs; /**< */
+        GeanyEditorPrefs *editor_prefs; /**< */
+} GeanyData;
+
+/**
+ * @brief Plugin description
+ */
+typedef struct PluginInfo {
+        const gchar *name; /**< */
+        const gchar *description; /**< */
+        const gchar *version; /**< */
+        const gchar *author; /**< */
+} PluginInfo;
+
+/**
+ * @brief Signal handler of a plugin
+ */
+typedef struct PluginCallback {
+        const gchar *signal_name; /**< Geany signal */
+        GCallback callback; /**< Handler */
+        gboolean after; /**< Run after Geany's own handlers */
+        gpointer user_data; /**< */
+} PluginCallback;
+
+typedef struct GeanyPlugin GeanyPlugin;
+
+/**
+ * @brief Plugin entry points
+ */
+typedef struct GeanyPluginFuncs {
+        PluginCallback *callbacks; /**< NULL terminated signal handlers */
+        gboolean (*init)(GeanyPlugin *plugin, gpointer pdata); /**< */
+        GtkWidget *(*configure)(GeanyPlugin *plugin, gpointer dialog, gpointer pdata); /**< */
+        void (*help)(GeanyPlugin *plugin, gpointer pdata); /**< */
+        void (*cleanup)(GeanyPlugin *plugin, gpointer pdata); /**< */
+} GeanyPluginFuncs;
+
+/**
+ * @brief Loaded plugin
+ */
+struct GeanyPlugin {
+        PluginInfo *info; /**< */
+        GeanyData *geany_data; /**< */
+        GeanyPluginFuncs *funcs; /**< */
+        gpointer proxy_funcs; /**< */
+        gpointer priv; /**< */
+};
+
+extern GeanyData *geany_data;
+extern GPtrArray *documents_array;
+extern GPtrArray *filetypes_array;
+
+#define GEANY(symbol_name) geany_data->symbol_name
+#define documents ((GeanyDocument **) GEANY(documents_array)->pdata)
+#define document_index(idx) (documents[idx])
+#define foreach_document(i) \
+        for (i = 0; i < GEANY(documents_array)->len; i++) \
+                if (!documents[i]->is_valid) \
+                        {} \
+                else
+
+#define GEANY_PLUGIN_REGISTER(plugin, min_api_version) \
+        geany_plugin_register((plugin), GEANY_API_VERSION, \
+                              (min_api_version), GEANY_ABI_VERSION)
+
+gboolean geany_plugin_register(GeanyPlugin *plugin, gint api_version,
+                               gint min_api_version, gint abi_version);
+void plugin_module_make_resident(GeanyPlugin *plugin);
+
+GeanyDocument *document_find_by_id(guint id);
+void document_set_encoding(GeanyDocument *doc, const gchar *new_encoding);
+gboolean document_reload_force(GeanyDocument *doc, const gchar *forced_enc);
+void document_set_filetype(GeanyDocument *doc, GeanyFiletype *type);
+void document_set_text_changed(GeanyDocument *doc, gboolean changed);
+
+const GeanyIndentPrefs *editor_get_indent_prefs(GeanyEditor *editor);
+void editor_set_indent_type(GeanyEditor *editor, GeanyIndentType type);
+void editor_set_indent_width(GeanyEditor *editor, gint width);
+
+GeanyFiletype *filetypes_lookup_by_name(const gchar *name);
+GeanyFiletype *filetypes_index(gint idx);
+
+gint sci_get_length(ScintillaObject *sci);
+gint sci_get_line_count(ScintillaObject *sci);
+gchar *sci_get_line(ScintillaObject *sci, gint line_num);
+gint sci_get_position_from_line(ScintillaObject *sci, gint line);
+gint sci_get_current_position(ScintillaObject *sci);
+void sci_set_current_position(ScintillaObject *sci, gint position, gboolean scroll_to_caret);
+void sci_set_text(ScintillaObject *sci, const gchar *text);
+void sci_set_readonly(ScintillaObject *sci, gboolean readonly);
+
+void ui_add_document_sensitive(GtkWidget *widget);
+void ui_progress_bar_start(const gchar *text);
+void ui_progress_bar_stop(void);
+void ui_set_statusbar(gboolean log, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
+
+#endif
@@ -0,0 +1,1038 @@
+// vim: expandtab:ts=8:encoding=UTF-8
+
+/*
+ * In-memory Geany for the headless driver: documents, filetypes, the
+ * plugin API modeline.c calls, and a Scintilla whose text lives in a gap
+ * buffer.  Every editor call the plugin makes is tallied in mock_calls[]
+ * by the kinds of the plugin's counters file, so the driver can check that
+ * none of them bypasses the plugin's counting wrappers.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mock.h"
+
+#define MOCK_GAP_MIN 4096 /**< Smallest gap left after growing the buffer */
+
+/**
+ * @brief Scintilla: text with a gap at the last edit, and what the plugin
+ *        sets on the view
+ */
+struct ScintillaObject {
+        gchar *buf; /**< Text, with the gap at gap_start..gap_end */
+        gsize size; /**< Allocated bytes of buf */
+        gsize gap_start; /**< Gap start, also the position of the gap */
+        gsize gap_end; /**< First byte after the gap */
+        GArray *line_starts; /**< Position of each line (gint), NULL after edits */
+        GArray *fold_levels; /**< Fold level of each line (gint), NULL after edits */
+        gint current_pos; /**< Caret */
+        gint eol_mode; /**< SC_EOL_ mode */
+        gboolean readonly; /**< */
+        GHashTable *properties; /**< Lexer properties set with SCI_SETPROPERTY */
+        GeanyEditor *editor; /**< Editor of the widget */
+};
+
+/**
+ * @brief Document, with the editor and settings Geany keeps for it
+ */
+struct mock_document {
+        GeanyDocument doc; /**< Must be first */
+        GeanyEditor editor; /**< */
+        GeanyIndentPrefs indent; /**< Indentation set by the plugin */
+};
+
+/**
+ * @brief Filetypes the mock knows, in id order
+ */
+static const struct {
+        const gchar *name; /**< GeanyFiletype name */
+        const gchar *patterns; /**< File name globs, ';' separated */
+        const gchar *single; /**< Line comment */
+        const gchar *open; /**< Block comment start */
+        const gchar *close; /**< Block comment end */
+} mock_filetypes[] = {
+        { "None",        "",                                 NULL, NULL,     NULL },
+        { "C",           "*.c;*.h",                          "//", "/*",     "*/" },
+        { "C++",         "*.cpp;*.cxx;*.cc;*.hpp;*.hh",      "//", "/*",     "*/" },
+        { "C#",          "*.cs",                             "//", "/*",     "*/" },
+        { "Java",        "*.java",                           "//", "/*",     "*/" },
+        { "Javascript",  "*.js",                             "//", "/*",     "*/" },
+        { "Go",          "*.go",                             "//", "/*",     "*/" },
+        { "Rust",        "*.rs",                             "//", "/*",     "*/" },
+        { "CSS",         "*.css",                            NULL, "/*",     "*/" },
+        { "Python",      "*.py",                             "#",  "\"\"\"", "\"\"\"" },
+        { "Sh",          "*.sh;*.bash;configure",            "#",  NULL,     NULL },
+        { "Make",        "Makefile;makefile;GNUmakefile;*.mk", "#", NULL,    NULL },
+        { "Conf",        "*.conf;*.cfg;*.ini",               "#",  NULL,     NULL },
+        { "Perl",        "*.pl;*.pm",                        "#",  NULL,     NULL },
+        { "Ruby",        "*.rb",                             "#",  NULL,     NULL },
+        { "YAML",        "*.yml;*.yaml",                     "#",  NULL,     NULL },
+        { "Lua",         "*.lua",                            "--", NULL,     NULL },
+        { "SQL",         "*.sql",                            "--", "/*",     "*/" },
+        { "Haskell",     "*.hs",                             "--", "{-",     "-}" },
+        { "LaTeX",       "*.tex;*.sty",                      "%",  NULL,     NULL },
+        { "Lisp",        "*.lisp;*.el;*.scm",                ";",  NULL,     NULL },
+        { "ASM",         "*.asm;*.s",                        ";",  NULL,     NULL },
+        { "Fortran",     "*.f90;*.f95",                      "!",  NULL,     NULL },
+        { "HTML",        "*.html;*.htm",                     NULL, "<!--",   "-->" },
+        { "XML",         "*.xml",                            NULL, "<!--",   "-->" },
+        { "Markdown",    "*.md",                             NULL, "<!--",   "-->" },
+        { "Diff",        "*.diff;*.patch",                   NULL, NULL,     NULL },
+        { NULL,          NULL,                               NULL, NULL,     NULL }
+};
+
+const gchar *const mock_call_keys[] = {
+        "sci_messages",
+        "sci_line_reads",
+        "sci_queries",
+        "sci_edits",
+        "indent_calls",
+        "encoding_calls",
+        "document_calls",
+        NULL
+};
+
+guint64 mock_calls[MOCK_N_CALLS];
+
+GPtrArray *documents_array;
+GPtrArray *filetypes_array;
+
+/**< What Geany shares with the plugin */
+static GeanyData data;
+static GeanyApp app;
+static GeanyMainWidgets main_widgets;
+static GeanyEditorPrefs editor_prefs;
+static GeanyIndentPrefs default_indent = { 8, GEANY_INDENT_TYPE_SPACES, 8 };
+
+/**< The plugin, registered by geany_load_module() */
+static GeanyPlugin plugin;
+static PluginInfo plugin_info;
+static GeanyPluginFuncs plugin_funcs;
+static gboolean plugin_registered;
+
+/**< Tools menu item the plugin added, with its "activate" handler */
+static GtkWidget *menu_item;
+
+/**< Next document id */
+static guint next_doc_id = 1;
+
+/* Gap buffer */
+
+/**
+ * @brief Length of the text
+ */
+static gsize gap_length(ScintillaObject *sci)
+{
+        return sci->size - (sci->gap_end - sci->gap_start);
+}
+
+/**
+ * @brief Forget the line index and fold levels after an edit.
+ */
+static void gap_invalidate(ScintillaObject *sci)
+{
+        if (sci->line_starts)
+                g_array_free(sci->line_starts, TRUE);
+        sci->line_starts = NULL;
+        if (sci->fold_levels)
+                g_array_free(sci->fold_levels, TRUE);
+        sci->fold_levels = NULL;
+}
+
+/**
+ * @brief Move the gap to a position.
+ */
+static void gap_move(ScintillaObject *sci, gsize pos)
+{
+        gsize gap = sci->gap_end - sci->gap_start;
+
+        if (pos < sci->gap_start)
+                memmove(sci->buf + pos + gap, sci->buf + pos, sci->gap_start - pos);
+        else if (pos > sci->gap_start)
+                memmove(sci->buf + sci->gap_start, sci->buf + sci->gap_end, pos - sci->gap_start);
+        sci->gap_start = pos;
+        sci->gap_end = pos + gap;
+}
+
+/**
+ * @brief Make the gap at least len bytes long.
+ */
+static void gap_reserve(ScintillaObject *sci, gsize len)
+{
+        gsize tail = sci->size - sci->gap_end, size;
+
+        if (sci->gap_end - sci->gap_start >= len)
+                return;
+
+        size = MAX(sci->size * 2, gap_length(sci) + len + MOCK_GAP_MIN);
+        sci->buf = g_realloc(sci->buf, size);
+        memmove(sci->buf + size - tail, sci->buf + sci->gap_end, tail);
+        sci->gap_end = size - tail;
+        sci->size = size;
+}
+
+/**
+ * @brief Insert text.
+ */
+static void gap_insert(ScintillaObject *sci, gsize pos, const gchar *text, gsize len)
+{
+        gap_move(sci, pos);
+        gap_reserve(sci, len);
+        memcpy(sci->buf + sci->gap_start, text, len);
+        sci->gap_start += len;
+        gap_invalidate(sci);
+}
+
+/**
+ * @brief Delete text.
+ */
+static void gap_delete(ScintillaObject *sci, gsize pos, gsize len)
+{
+        gap_move(sci, pos);
+        sci->gap_end += len;
+        gap_invalidate(sci);
+}
+
+/**
+ * @brief Byte of the text at a position.
+ */
+static gchar gap_at(ScintillaObject *sci, gsize pos)
+{
+        return sci->buf[pos < sci->gap_start ? pos : pos + sci->gap_end - sci->gap_start];
+}
+
+/**
+ * @brief Copy a range of the text.
+ *
+ * @return NUL terminated copy, free with g_free()
+ */
+static gchar *gap_copy(ScintillaObject *sci, gsize start, gsize end)
+{
+        gchar *ret = g_malloc(end - start + 1);
+        gsize i;
+
+        for (i = start; i < end; i++)
+                ret[i - start] = gap_at(sci, i);
+        ret[end - start] = '\0';
+
+        return ret;
+}
+
+/**
+ * @brief The whole text in one piece, as SCI_GETCHARACTERPOINTER: the gap
+ *        is moved to the end.
+ */
+static const gchar *gap_contents(ScintillaObject *sci)
+{
+        gap_move(sci, gap_length(sci));
+        gap_reserve(sci, 1);
+        sci->buf[sci->gap_start] = '\0';
+
+        return sci->buf;
+}
+
+/**
+ * @brief Replace the text.
+ */
+static void gap_set(ScintillaObject *sci, const gchar *text)
+{
+        gap_delete(sci, 0, gap_length(sci));
+        gap_insert(sci, 0, text, strlen(text));
+}
+
+/**
+ * @brief Line index, built on demand.  "\r\n", "\r" and "\n" all end a
+ *        line, as in Scintilla.
+ */
+static GArray *gap_lines(ScintillaObject *sci)
+{
+        gsize len = gap_length(sci), i;
+        gint start = 0;
+        gchar c;
+
+        if (sci->line_starts)
+                return sci->line_starts;
+
+        sci->line_starts = g_array_new(FALSE, FALSE, sizeof(gint));
+        g_array_append_val(sci->line_starts, start);
+        for (i = 0; i < len; i++) {
+                c = gap_at(sci, i);
+                if (c == '\r' && i + 1 < len && gap_at(sci, i + 1) == '\n')
+                        continue;
+                if (c == '\r' || c == '\n') {
+                        start = i + 1;
+                        g_array_append_val(sci->line_starts, start);
+                }
+        }
+
+        return sci->line_starts;
+}
+
+/**
+ * @brief Position of a line, the text length past the last line.
+ */
+static gint gap_line_start(ScintillaObject *sci, gint line)
+{
+        GArray *lines = gap_lines(sci);
+
+        if (line < 0)
+                return 0;
+        if ((guint) line >= lines->len)
+                return gap_length(sci);
+        return g_array_index(lines, gint, line);
+}
+
+/**
+ * @brief Line of a position.
+ */
+static gint gap_line_from_position(ScintillaObject *sci, gint pos)
+{
+        GArray *lines = gap_lines(sci);
+        guint lo = 0, hi = lines->len, mid;
+
+        while (hi - lo > 1) {
+                mid = (lo + hi) / 2;
+                if (g_array_index(lines, gint, mid) <= pos)
+                        lo = mid;
+                else
+                        hi = mid;
+        }
+
+        return lo;
+}
+
+/**
+ * @brief Fold levels by brace depth, standing in for a folding lexer.
+ *        A line that opens more braces than it closes is a fold header.
+ */
+static GArray *gap_fold_levels(ScintillaObject *sci)
+{
+        GArray *lines = gap_lines(sci);
+        gint depth = 0, open, level, pos, end;
+        guint line;
+        gchar c;
+
+        if (sci->fold_levels)
+                return sci->fold_levels;
+
+        sci->fold_levels = g_array_sized_new(FALSE, FALSE, sizeof(gint), lines->len);
+        for (line = 0; line < lines->len; line++) {
+                level = SC_FOLDLEVELBASE + depth;
+                end = gap_line_start(sci, line + 1);
+                for (open = 0, pos = gap_line_start(sci, line); pos < end; pos++) {
+                        c = gap_at(sci, pos);
+                        if (c == '{')
+                                open++;
+                        else if (c == '}')
+                                open--;
+                }
+                depth = MAX(depth + open, 0);
+                if (open > 0)
+                        level |= SC_FOLDLEVELHEADERFLAG;
+                g_array_append_val(sci->fold_levels, level);
+        }
+
+        return sci->fold_levels;
+}
+
+/**
+ * @brief Last line of the fold a header line starts.
+ */
+static gint gap_last_child(ScintillaObject *sci, gint line)
+{
+        GArray *levels = gap_fold_levels(sci);
+        gint level, i;
+
+        if (line < 0 || (guint) line >= levels->len)
+                return line;
+
+        level = g_array_index(levels, gint, line) & SC_FOLDLEVELNUMBERMASK;
+        for (i = line + 1; (guint) i < levels->len; i++) {
+                if ((g_array_index(levels, gint, i) & SC_FOLDLEVELNUMBERMASK) <= level)
+                        break;
+        }
+
+        return i - 1;
+}
+
+/**
+ * @brief Rewrite every line end for an end of line mode.
+ */
+static void gap_convert_eols(ScintillaObject *sci, gint mode)
+{
+        static const gchar *const eols[] = { "\r\n", "\r", "\n" };
+        gsize len = gap_length(sci), i;
+        GString *out;
+        gchar c;
+
+        out = g_string_sized_new(len);
+        for (i = 0; i < len; i++) {
+                c = gap_at(sci, i);
+                if (c == '\r' && i + 1 < len && gap_at(sci, i + 1) == '\n')
+                        i++;
+                if (c == '\r' || c == '\n')
+                        g_string_append(out, eols[CLAMP(mode, SC_EOL_CRLF, SC_EOL_LF)]);
+                else
+                        g_string_append_c(out, c);
+        }
+        gap_set(sci, out->str);
+        g_string_free(out, TRUE);
+}
+
+/**
+ * @brief Create an empty editor widget.
+ */
+static ScintillaObject *sci_new(GeanyEditor *editor)
+{
+        ScintillaObject *sci = g_new0(ScintillaObject, 1);
+
+        sci->size = MOCK_GAP_MIN;
+        sci->buf = g_malloc(sci->size);
+        sci->gap_end = sci->size;
+        sci->eol_mode = SC_EOL_LF;
+        sci->properties = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        sci->editor = editor;
+
+        return sci;
+}
+
+/**
+ * @brief Destroy an editor widget.
+ */
+static void sci_free(ScintillaObject *sci)
+{
+        gap_invalidate(sci);
+        g_hash_table_destroy(sci->properties);
+        g_free(sci->buf);
+        g_free(sci);
+}
+
+/* Plugin signals */
+
+/**
+ * @brief Find the plugin's handler of a signal.
+ */
+static PluginCallback *callback_find(const gchar *signal)
+{
+        PluginCallback *cb;
+
+        if (!plugin_registered || !plugin_funcs.callbacks)
+                return NULL;
+
+        for (cb = plugin_funcs.callbacks; cb->signal_name; cb++) {
+                if (!strcmp(cb->signal_name, signal))
+                        return cb;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Emit a document-* signal.
+ */
+static void emit_document(const gchar *signal, GeanyDocument *doc)
+{
+        PluginCallback *cb = callback_find(signal);
+
+        if (cb)
+                ((void (*)(GObject *, GeanyDocument *, gpointer)) cb->callback)(NULL, doc, cb->user_data);
+}
+
+/**
+ * @brief Emit editor-notify.
+ */
+static void emit_notify(GeanyEditor *editor, SCNotification *nt)
+{
+        PluginCallback *cb = callback_find("editor-notify");
+
+        nt->nmhdr.hwndFrom = editor->sci;
+        if (cb)
+                ((gboolean (*)(GObject *, GeanyEditor *, SCNotification *, gpointer)) cb->callback)
+                        (NULL, editor, nt, cb->user_data);
+}
+
+/* GTK */
+
+/**
+ * @brief Class of menu items: a GObject with an "activate" signal
+ */
+static void mock_widget_class_init(gpointer klass, gpointer class_data)
+{
+        g_signal_new("activate", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                     0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+/**
+ * @brief Type of menu items
+ */
+static GType mock_widget_get_type(void)
+{
+        static GType type;
+
+        if (!type)
+                type = g_type_register_static_simple(G_TYPE_OBJECT, "MockWidget",
+                                                     sizeof(GObjectClass), mock_widget_class_init,
+                                                     sizeof(GObject), NULL, 0);
+        return type;
+}
+
+GtkWidget *gtk_menu_item_new_with_mnemonic(const gchar *label)
+{
+        menu_item = g_object_new(mock_widget_get_type(), NULL);
+        return menu_item;
+}
+
+void gtk_widget_show(GtkWidget *widget)
+{
+}
+
+void gtk_widget_destroy(GtkWidget *widget)
+{
+        if (widget == menu_item)
+                menu_item = NULL;
+        g_object_unref(widget);
+}
+
+void gtk_container_add(gpointer container, GtkWidget *widget)
+{
+}
+
+/* Geany */
+
+gboolean geany_plugin_register(GeanyPlugin *p, gint api_version,
+                               gint min_api_version, gint abi_version)
+{
+        plugin_registered = p == &plugin && min_api_version <= GEANY_API_VERSION &&
+                abi_version == GEANY_ABI_VERSION && p->funcs->init && p->funcs->cleanup;
+        return plugin_registered;
+}
+
+void plugin_module_make_resident(GeanyPlugin *p)
+{
+}
+
+void ui_add_document_sensitive(GtkWidget *widget)
+{
+}
+
+void ui_progress_bar_start(const gchar *text)
+{
+}
+
+void ui_progress_bar_stop(void)
+{
+}
+
+void ui_set_statusbar(gboolean log, const gchar *format, ...)
+{
+}
+
+GeanyFiletype *filetypes_index(gint idx)
+{
+        return (idx >= 0 && (guint) idx < filetypes_array->len) ?
+                g_ptr_array_index(filetypes_array, idx) : NULL;
+}
+
+GeanyFiletype *filetypes_lookup_by_name(const gchar *name)
+{
+        GeanyFiletype *ft;
+        guint i;
+
+        for (i = 0; i < filetypes_array->len; i++) {
+                ft = g_ptr_array_index(filetypes_array, i);
+                if (!strcmp(ft->name, name))
+                        return ft;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Filetype of a file name, by the filetypes' globs
+ */
+static GeanyFiletype *filetypes_detect(const gchar *path)
+{
+        GeanyFiletype *ft;
+        gchar *base, **pat;
+        guint i;
+
+        base = g_path_get_basename(path);
+        for (i = 1; i < filetypes_array->len; i++) {
+                ft = g_ptr_array_index(filetypes_array, i);
+                for (pat = ft->pattern; *pat; pat++) {
+                        if (**pat && g_pattern_match_simple(*pat, base)) {
+                                g_free(base);
+                                return ft;
+                        }
+                }
+        }
+        g_free(base);
+
+        return filetypes_index(GEANY_FILETYPES_NONE);
+}
+
+GeanyDocument *document_find_by_id(guint id)
+{
+        GeanyDocument *doc;
+        guint i;
+
+        for (i = 0; i < documents_array->len; i++) {
+                doc = g_ptr_array_index(documents_array, i);
+                if (doc->is_valid && doc->id == id)
+                        return doc;
+        }
+
+        return NULL;
+}
+
+void document_set_encoding(GeanyDocument *doc, const gchar *new_encoding)
+{
+        gchar *old = doc->encoding;
+
+        mock_calls[MOCK_ENCODING]++;
+        doc->encoding = g_strdup(new_encoding);
+        g_free(old);
+}
+
+/**
+ * @brief Read a file into a document's buffer.
+ *
+ * @param doc Document
+ * @param enc Encoding of the file, NULL to take UTF-8 and fall back to
+ *        ISO-8859-1 as Geany's detection would for most files
+ *
+ * @return TRUE if the file was read and decoded
+ */
+static gboolean document_load(GeanyDocument *doc, const gchar *enc)
+{
+        gchar *raw, *text;
+        gsize len;
+
+        if (!g_file_get_contents(doc->real_path, &raw, &len, NULL))
+                return FALSE;
+
+        if (!enc)
+                enc = g_utf8_validate(raw, len, NULL) ? "UTF-8" : "ISO-8859-1";
+        if (!g_ascii_strcasecmp(enc, "UTF-8"))
+                text = raw;
+        else {
+                text = g_convert(raw, len, "UTF-8", enc, NULL, NULL, NULL);
+                g_free(raw);
+                if (!text)
+                        return FALSE;
+        }
+
+        gap_set(doc->editor->sci, text);
+        g_free(text);
+        // enc may be doc->encoding itself
+        text = doc->encoding;
+        doc->encoding = g_strdup(enc);
+        g_free(text);
+        doc->changed = FALSE;
+
+        return TRUE;
+}
+
+gboolean document_reload_force(GeanyDocument *doc, const gchar *forced_enc)
+{
+        mock_calls[MOCK_ENCODING]++;
+        if (!document_load(doc, forced_enc))
+                return FALSE;
+        emit_document("document-reload", doc);
+        return TRUE;
+}
+
+void document_set_filetype(GeanyDocument *doc, GeanyFiletype *type)
+{
+        mock_calls[MOCK_DOCUMENT]++;
+        doc->file_type = type;
+}
+
+void document_set_text_changed(GeanyDocument *doc, gboolean changed)
+{
+        mock_calls[MOCK_DOCUMENT]++;
+        doc->changed = changed;
+}
+
+const GeanyIndentPrefs *editor_get_indent_prefs(GeanyEditor *editor)
+{
+        mock_calls[MOCK_INDENT]++;
+        return &((struct mock_document *) editor->document)->indent;
+}
+
+void editor_set_indent_type(GeanyEditor *editor, GeanyIndentType type)
+{
+        mock_calls[MOCK_INDENT]++;
+        ((struct mock_document *) editor->document)->indent.type = type;
+}
+
+void editor_set_indent_width(GeanyEditor *editor, gint width)
+{
+        mock_calls[MOCK_INDENT]++;
+        ((struct mock_document *) editor->document)->indent.width = width;
+}
+
+/* Scintilla */
+
+sptr_t scintilla_send_message(ScintillaObject *sci, unsigned int msg, uptr_t wparam, sptr_t lparam)
+{
+        GArray *levels;
+        const gchar *value;
+
+        mock_calls[MOCK_SCI_MESSAGES]++;
+
+        switch (msg) {
+        case SCI_GETLENGTH:
+                return gap_length(sci);
+        case SCI_GETLINECOUNT:
+                return gap_lines(sci)->len;
+        case SCI_POSITIONFROMLINE:
+                return gap_line_start(sci, wparam);
+        case SCI_LINEFROMPOSITION:
+                return gap_line_from_position(sci, wparam);
+        case SCI_GETCURRENTPOS:
+                return sci->current_pos;
+        case SCI_GETCHARACTERPOINTER:
+                return (sptr_t) gap_contents(sci);
+        case SCI_SETTEXT:
+                gap_set(sci, (const gchar *) lparam);
+                return 0;
+        case SCI_GETREADONLY:
+                return sci->readonly;
+        case SCI_SETREADONLY:
+                sci->readonly = wparam;
+                return 0;
+        case SCI_GETEOLMODE:
+                return sci->eol_mode;
+        case SCI_SETEOLMODE:
+                sci->eol_mode = wparam;
+                return 0;
+        case SCI_CONVERTEOLS:
+                gap_convert_eols(sci, wparam);
+                return 0;
+        case SCI_SETPROPERTY:
+                g_hash_table_replace(sci->properties, g_strdup((const gchar *) wparam),
+                                     g_strdup((const gchar *) lparam));
+                return 0;
+        case SCI_GETPROPERTYINT:
+                value = g_hash_table_lookup(sci->properties, (const gchar *) wparam);
+                return value ? atoi(value) : lparam;
+        case SCI_GETENDSTYLED:
+                // There is no lexer, all text counts as styled
+                return gap_length(sci);
+        case SCI_GETFOLDLEVEL:
+                levels = gap_fold_levels(sci);
+                return wparam < levels->len ? g_array_index(levels, gint, wparam) : SC_FOLDLEVELBASE;
+        case SCI_GETLASTCHILD:
+                return gap_last_child(sci, wparam);
+        default:
+                // View settings: wrapping, caches, folds, undo and the like
+                return 0;
+        }
+}
+
+gint sci_get_length(ScintillaObject *sci)
+{
+        mock_calls[MOCK_SCI_QUERIES]++;
+        return gap_length(sci);
+}
+
+gint sci_get_line_count(ScintillaObject *sci)
+{
+        mock_calls[MOCK_SCI_LINES]++;
+        return gap_lines(sci)->len;
+}
+
+gchar *sci_get_line(ScintillaObject *sci, gint line_num)
+{
+        mock_calls[MOCK_SCI_LINES]++;
+        return gap_copy(sci, gap_line_start(sci, line_num), gap_line_start(sci, line_num + 1));
+}
+
+gint sci_get_position_from_line(ScintillaObject *sci, gint line)
+{
+        mock_calls[MOCK_SCI_QUERIES]++;
+        return gap_line_start(sci, line);
+}
+
+gint sci_get_current_position(ScintillaObject *sci)
+{
+        mock_calls[MOCK_SCI_QUERIES]++;
+        return sci->current_pos;
+}
+
+void sci_set_current_position(ScintillaObject *sci, gint position, gboolean scroll_to_caret)
+{
+        mock_calls[MOCK_SCI_EDITS]++;
+        sci->current_pos = CLAMP(position, 0, (gint) gap_length(sci));
+}
+
+void sci_set_text(ScintillaObject *sci, const gchar *text)
+{
+        mock_calls[MOCK_SCI_EDITS]++;
+        gap_set(sci, text);
+}
+
+void sci_set_readonly(ScintillaObject *sci, gboolean readonly)
+{
+        mock_calls[MOCK_SCI_EDITS]++;
+        sci->readonly = readonly;
+}
+
+/* Driver side */
+
+/**
+ * @brief Set up the application: filetypes, preferences and an empty
+ *        document list.
+ *
+ * @param configdir Configuration directory, the plugin reads
+ *        plugins/modeline/modeline.conf in it
+ */
+void mock_init(const gchar *configdir)
+{
+        GeanyFiletype *ft;
+        guint i;
+
+        app.configdir = g_strdup(configdir);
+        editor_prefs.indentation = &default_indent;
+        editor_prefs.folding = TRUE;
+        main_widgets.tools_menu = g_object_new(mock_widget_get_type(), NULL);
+
+        data.app = &app;
+        data.main_widgets = &main_widgets;
+        data.editor_prefs = &editor_prefs;
+        data.documents_array = documents_array = g_ptr_array_new();
+        data.filetypes_array = filetypes_array = g_ptr_array_new();
+
+        for (i = 0; mock_filetypes[i].name; i++) {
+                ft = g_new0(GeanyFiletype, 1);
+                ft->id = i;
+                ft->name = g_strdup(mock_filetypes[i].name);
+                ft->title = g_strdup(mock_filetypes[i].name);
+                ft->pattern = g_strsplit(mock_filetypes[i].patterns, ";", -1);
+                ft->comment_single = g_strdup(mock_filetypes[i].single);
+                ft->comment_open = g_strdup(mock_filetypes[i].open);
+                ft->comment_close = g_strdup(mock_filetypes[i].close);
+                g_ptr_array_add(filetypes_array, ft);
+        }
+}
+
+/**
+ * @brief Load the plugin as Geany does: geany_load_module(), then init.
+ */
+void mock_plugin_load(void)
+{
+        plugin.info = &plugin_info;
+        plugin.funcs = &plugin_funcs;
+        plugin.geany_data = &data;
+
+        geany_load_module(&plugin);
+        if (!plugin_registered)
+                g_error("mock: the plugin did not register");
+        if (!plugin_funcs.init(&plugin, NULL))
+                g_error("mock: the plugin failed to initialize");
+}
+
+/**
+ * @brief Unload the plugin.
+ */
+void mock_plugin_unload(void)
+{
+        plugin_funcs.cleanup(&plugin, NULL);
+        plugin_registered = FALSE;
+}
+
+/**
+ * @brief Open a file in a new document, reusing a closed document's slot
+ *        as Geany does, and emit document-open.
+ *
+ * @param path File
+ *
+ * @return Document, NULL if the file cannot be read
+ */
+GeanyDocument *mock_document_open(const gchar *path)
+{
+        struct mock_document *md = NULL;
+        GeanyDocument *doc;
+        guint i;
+
+        for (i = 0; i < documents_array->len; i++) {
+                doc = g_ptr_array_index(documents_array, i);
+                if (!doc->is_valid) {
+                        md = (struct mock_document *) doc;
+                        break;
+                }
+        }
+        if (!md) {
+                md = g_new0(struct mock_document, 1);
+                md->doc.index = documents_array->len;
+                g_ptr_array_add(documents_array, md);
+        }
+
+        doc = &md->doc;
+        doc->editor = &md->editor;
+        md->editor.document = doc;
+        md->editor.sci = sci_new(&md->editor);
+        md->editor.line_wrapping = editor_prefs.line_wrapping;
+        md->indent = default_indent;
+        doc->file_name = g_strdup(path);
+        doc->real_path = g_canonicalize_filename(path, NULL);
+        doc->file_type = filetypes_detect(path);
+
+        if (!document_load(doc, NULL)) {
+                mock_document_close(doc);
+                return NULL;
+        }
+
+        doc->id = next_doc_id++;
+        doc->is_valid = TRUE;
+        emit_document("document-open", doc);
+
+        return doc;
+}
+
+/**
+ * @brief Find the open document of a file.
+ *
+ * @param path File
+ *
+ * @return Document, NULL if the file is not open
+ */
+GeanyDocument *mock_document_find(const gchar *path)
+{
+        GeanyDocument *doc;
+        gchar *real;
+        guint i;
+
+        real = g_canonicalize_filename(path, NULL);
+        for (i = 0; i < documents_array->len; i++) {
+                doc = g_ptr_array_index(documents_array, i);
+                if (doc->is_valid && !strcmp(doc->real_path, real)) {
+                        g_free(real);
+                        return doc;
+                }
+        }
+        g_free(real);
+
+        return NULL;
+}
+
+/**
+ * @brief Save a document and emit document-save.  The file is left as it
+ *        is, so a corpus can be replayed any number of times.
+ *
+ * @param doc Document
+ */
+void mock_document_save(GeanyDocument *doc)
+{
+        doc->changed = FALSE;
+        emit_document("document-save", doc);
+}
+
+/**
+ * @brief Emit document-close and free the document's slot.
+ *
+ * @param doc Document
+ */
+void mock_document_close(GeanyDocument *doc)
+{
+        if (doc->is_valid)
+                emit_document("document-close", doc);
+
+        doc->is_valid = FALSE;
+        sci_free(doc->editor->sci);
+        doc->editor->sci = NULL;
+        g_free(doc->file_name);
+        doc->file_name = NULL;
+        g_free(doc->real_path);
+        doc->real_path = NULL;
+        g_free(doc->encoding);
+        doc->encoding = NULL;
+}
+
+/**
+ * @brief Type text into a document, with the editor-notify Geany would
+ *        forward.
+ *
+ * @param doc Document
+ * @param pos Position
+ * @param text Text
+ */
+void mock_insert_text(GeanyDocument *doc, gint pos, const gchar *text)
+{
+        SCNotification nt = { { NULL, 0, SCN_MODIFIED }, 0, 0, NULL, 0, 0 };
+
+        gap_insert(doc->editor->sci, pos, text, strlen(text));
+        doc->changed = TRUE;
+
+        nt.position = pos;
+        nt.modificationType = SC_MOD_INSERTTEXT;
+        nt.text = text;
+        nt.length = strlen(text);
+        emit_notify(doc->editor, &nt);
+}
+
+/**
+ * @brief Delete text from a document, with the editor-notify Geany would
+ *        forward.
+ *
+ * @param doc Document
+ * @param pos Position
+ * @param len Bytes to delete
+ */
+void mock_delete_text(GeanyDocument *doc, gint pos, gint len)
+{
+        SCNotification nt = { { NULL, 0, SCN_MODIFIED }, 0, 0, NULL, 0, 0 };
+
+        gap_delete(doc->editor->sci, pos, len);
+        doc->changed = TRUE;
+
+        nt.position = pos;
+        nt.modificationType = SC_MOD_DELETETEXT;
+        nt.length = len;
+        emit_notify(doc->editor, &nt);
+}
+
+/**
+ * @brief Activate the plugin's Tools menu item.
+ */
+void mock_apply_all(void)
+{
+        if (menu_item)
+                g_signal_emit_by_name(menu_item, "activate");
+}
+
+/**
+ * @brief Read what a document is set to, without counting editor calls.
+ *
+ * @param doc Document
+ * @param set Filled in, the strings belong to the document
+ */
+void mock_document_settings(GeanyDocument *doc, struct mock_settings *set)
+{
+        struct mock_document *md = (struct mock_document *) doc;
+
+        set->filetype = doc->file_type ? doc->file_type->name : NULL;
+        set->encoding = doc->encoding;
+        set->indent_width = md->indent.width;
+        set->expand_tab = md->indent.type == GEANY_INDENT_TYPE_SPACES;
+        set->wrap = md->editor.line_wrapping;
+        set->eol_mode = md->editor.sci->eol_mode;
+        set->readonly = md->editor.sci->readonly;
+}
+
+/**
+ * @brief Put a document's indentation and wrapping back to the
+ *        preferences, as a user choosing them from Geany's menus would.
+ *        The plugin is not told.
+ *
+ * @param doc Document
+ */
+void mock_document_reset(GeanyDocument *doc)
+{
+        struct mock_document *md = (struct mock_document *) doc;
+
+        md->indent = default_indent;
+        md->editor.line_wrapping = editor_prefs.line_wrapping;
+}
@@ -0,0 +1,60 @@
+// vim: expandtab:ts=8:encoding=UTF-8
+
+/*
+ * Driver side of the mock Geany, see mock.c
+ */
+
+#ifndef ML_BENCH_MOCK_H
+#define ML_BENCH_MOCK_H
+
+#include "geanyplugin.h"
+
+/**
+ * @brief Kinds of editor calls, as the plugin counts them
+ */
+enum mock_call {
+        MOCK_SCI_MESSAGES, /**< scintilla_send_message() */
+        MOCK_SCI_LINES, /**< sci_get_line() and sci_get_line_count() */
+        MOCK_SCI_QUERIES, /**< sci_get_length() and the sci_get_*_position() calls */
+        MOCK_SCI_EDITS, /**< sci_set_text(), sci_set_readonly() and sci_set_current_position() */
+        MOCK_INDENT, /**< editor_get_indent_prefs() and the editor_set_indent_*() calls */
+        MOCK_ENCODING, /**< document_set_encoding() and document_reload_force() */
+        MOCK_DOCUMENT, /**< document_set_filetype() and document_set_text_changed() */
+        MOCK_N_CALLS
+};
+
+/**
+ * @brief What a document is set to, as the user sees it in Geany
+ */
+struct mock_settings {
+        const gchar *filetype; /**< Filetype name */
+        const gchar *encoding; /**< Charset */
+        gint indent_width; /**< */
+        gboolean expand_tab; /**< Indentation uses spaces */
+        gboolean wrap; /**< Lines are wrapped */
+        gint eol_mode; /**< SC_EOL_ mode */
+        gboolean readonly; /**< */
+};
+
+/**< Keys of the plugin's counters file, in the order of enum mock_call */
+extern const gchar *const mock_call_keys[];
+
+/**< Editor calls the plugin made, enum mock_call */
+extern guint64 mock_calls[MOCK_N_CALLS];
+
+void geany_load_module(GeanyPlugin *plugin);
+
+void mock_init(const gchar *configdir);
+void mock_plugin_load(void);
+void mock_plugin_unload(void);
+GeanyDocument *mock_document_open(const gchar *path);
+GeanyDocument *mock_document_find(const gchar *path);
+void mock_document_save(GeanyDocument *doc);
+void mock_document_close(GeanyDocument *doc);
+void mock_insert_text(GeanyDocument *doc, gint pos, const gchar *text);
+void mock_delete_text(GeanyDocument *doc, gint pos, gint len);
+void mock_apply_all(void);
+void mock_document_settings(GeanyDocument *doc, struct mock_settings *set);
+void mock_document_reset(GeanyDocument *doc);
+
+#endif
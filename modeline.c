@@ -1,22 +1,73 @@
 // vim: expandtab:ts=8:encoding=UTF-8
 
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "geanyplugin.h"
 
+/* Optimized builds hide every symbol (-fvisibility=hidden) but the entry
+ * point, and older GLib releases leave G_MODULE_EXPORT empty outside Windows */
+#if defined(__GNUC__) && !defined(G_PLATFORM_WIN32)
+#undef G_MODULE_EXPORT
+#define G_MODULE_EXPORT __attribute__((visibility("default")))
+#endif
+
 #define DEBUG_MODE 1
 
+#define ML_SCAN_LINES 50 /**< Lines inspected at each end of a document */
+#define ML_WINDOW_BYTES 8192 /**< Bytes read from each end of a large file */
+#define ML_LARGE_FILE_SIZE (16 << 20) /**< Default large_file_size */
+#define ML_LARGE_FILE_PROFILE "nowrap nofoldenable idlestyling=afterview layoutcache=page" /**< Defaults for large documents */
+#define ML_ASYNC_DECODE_SIZE (1 << 20) /**< Re-decode larger files off thread */
+#define ML_CACHE_MAX 4096 /**< Files whose parsed modelines are kept */
+#define ML_SLICE_BUDGET 2000 /**< us a scan may take per main loop dispatch */
+#define ML_LIVE_DELAY 500 /**< ms after the last edit of a modeline to apply it */
+#define ML_COUNTERS_INTERVAL 300 /**< s between writes of the counters file */
+#define ML_FOLD_MARGIN 2 /**< Geany's fold margin */
+#define ML_FOLD_MARGIN_WIDTH 12 /**< Width Geany gives the fold margin */
+
 GeanyPlugin *geany_plugin;
 GeanyData *geany_data;
 
-static void scan_document(GeanyDocument *doc);
-static void parse_options(GeanyDocument *doc, gchar *buf);
-static void interpret_option(GeanyDocument *doc, gchar *opt);
+static gint ml_sci_get_length(ScintillaObject *sci);
+static void scan_document(GeanyDocument *doc, guint flags);
+static struct ml_comments *comments_new(GeanyFiletype *ft);
+static void comments_free(struct ml_comments *comments);
+static gboolean parse_window(gchar **lines, GArray *settings, struct ml_comments *comments);
+static gboolean scan_line(gchar *buf, GArray *settings, struct ml_comments *comments);
+static void parse_options(gchar *buf, GArray *settings, gboolean geany_ns);
+static void interpret_option(gchar *opt, GArray *settings, gboolean geany_ns);
+static void redecode_async(GeanyDocument *doc, const gchar *old_enc);
+static void reload_if_needed(GeanyDocument *doc, const gchar *old_enc);
+static void batch_start(void);
 static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer user_data);
 static void on_document_save(GObject *obj, GeanyDocument *doc, gpointer user_data);
+static void on_document_reload(GObject *obj, GeanyDocument *doc, gpointer user_data);
+static void on_document_activate(GObject *obj, GeanyDocument *doc, gpointer user_data);
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer user_data);
+static gboolean on_editor_notify(GObject *obj, GeanyEditor *editor, SCNotification *nt,
+                                 gpointer user_data);
 
 static void opt_expand_tab(GeanyDocument *doc, void *arg);
 static void opt_tab_stop(GeanyDocument *doc, void *arg);
 static void opt_wrap(GeanyDocument *doc, void *arg);
 static void opt_enc(GeanyDocument *doc, void *arg);
+static void opt_filetype(GeanyDocument *doc, void *arg);
+static void opt_no_lexer(GeanyDocument *doc, void *arg);
+static void opt_fileformat(GeanyDocument *doc, void *arg);
+static void opt_idle_styling(GeanyDocument *doc, void *arg);
+static void opt_layout_cache(GeanyDocument *doc, void *arg);
+static void opt_caret_line(GeanyDocument *doc, void *arg);
+static void opt_whitespace(GeanyDocument *doc, void *arg);
+static void opt_indent_guides(GeanyDocument *doc, void *arg);
+static void opt_fold_enable(GeanyDocument *doc, void *arg);
+static void opt_fold_level(GeanyDocument *doc, void *arg);
+static void opt_readonly(GeanyDocument *doc, void *arg);
+static void opt_modifiable(GeanyDocument *doc, void *arg);
+static void opt_undo_levels(GeanyDocument *doc, void *arg);
 
 #define debugf(fmt, ...) \
         do { if (DEBUG_MODE) printf(fmt, ## __VA_ARGS__); } while (0)
@@ -25,6 +76,10 @@ static void opt_enc(GeanyDocument *doc, void *arg);
 PluginCallback plugin_callbacks[] = {
         { "document-open", (GCallback) &on_document_open, TRUE, NULL },
         { "document-save", (GCallback) &on_document_save, TRUE, NULL },
+        { "document-reload", (GCallback) &on_document_reload, TRUE, NULL },
+        { "document-activate", (GCallback) &on_document_activate, TRUE, NULL },
+        { "document-close", (GCallback) &on_document_close, TRUE, NULL },
+        { "editor-notify", (GCallback) &on_editor_notify, FALSE, NULL },
         { NULL, NULL, FALSE, NULL }
 };
 
@@ -36,6 +91,53 @@ enum mode_opt_arg {
         MODE_OPT_ARG_TRUE, /**< No argument, true */
         MODE_OPT_ARG_FALSE, /**< No argument, false */
         MODE_OPT_ARG_STR, /**< String argument */
+        MODE_OPT_ARG_ENUM, /**< One of a fixed set of strings, passed as its index */
+};
+
+/**
+ * @brief Mode option flags
+ */
+enum mode_opt_flag {
+        MODE_OPT_EARLY = 1 << 0, /**< Apply before other options */
+        MODE_OPT_GEANY = 1 << 1, /**< Only accepted in geany: modelines */
+};
+
+/**
+ * @brief scan_document() flags
+ */
+enum ml_scan_flag {
+        ML_SCAN_CACHE = 1 << 0, /**< The file's cached modeline may be used */
+        ML_SCAN_OPEN = 1 << 1, /**< Reload if the encoding changed, when done */
+        ML_SCAN_SAVE = 1 << 2, /**< The buffer is saved, never reload for it */
+};
+
+/**
+ * @brief Cumulative counters, see counter_keys[]
+ */
+enum ml_counter {
+        ML_COUNT_SCANNED, /**< Documents whose windows were scanned */
+        ML_COUNT_BYTES, /**< Bytes of window lines scanned */
+        ML_COUNT_FOUND, /**< Modelines found */
+        ML_COUNT_APPLIED, /**< Options applied to documents */
+        ML_COUNT_RELOADS, /**< Reloads for a changed encoding */
+        ML_COUNT_RELOADS_AVOIDED, /**< Encoding changes that needed no reload */
+        ML_COUNT_CALLBACK_USEC, /**< Time spent in hooks and main loop sources */
+        // Editor calls, each count followed by the time they took, see counters_call()
+        ML_COUNT_SCI_MESSAGES, /**< scintilla_send_message() */
+        ML_COUNT_SCI_MESSAGES_USEC,
+        ML_COUNT_SCI_LINES, /**< sci_get_line() and sci_get_line_count() */
+        ML_COUNT_SCI_LINES_USEC,
+        ML_COUNT_SCI_QUERIES, /**< sci_get_length() and the sci_get_*_position() calls */
+        ML_COUNT_SCI_QUERIES_USEC,
+        ML_COUNT_SCI_EDITS, /**< sci_set_text(), sci_set_readonly() and sci_set_current_position() */
+        ML_COUNT_SCI_EDITS_USEC,
+        ML_COUNT_INDENT, /**< editor_get_indent_prefs() and the editor_set_indent_*() calls */
+        ML_COUNT_INDENT_USEC,
+        ML_COUNT_ENCODING, /**< document_set_encoding() and document_reload_force() */
+        ML_COUNT_ENCODING_USEC,
+        ML_COUNT_DOCUMENT, /**< document_set_filetype() and document_set_text_changed() */
+        ML_COUNT_DOCUMENT_USEC,
+        ML_N_COUNTERS
 };
 
 /**
@@ -46,24 +148,431 @@ struct mode_opt {
         const gchar *alias; /**< Short alias of option */
         enum mode_opt_arg arg_type; /**< Argument type for option */
         void (*cb)(GeanyDocument *, void *); /**< */
+        guint flags; /**< enum mode_opt_flag */
+        gint min; /**< Smallest integer value */
+        gint max; /**< Largest integer value, or longest string */
+        const gchar *const *choices; /**< NULL terminated enum values */
 };
 
-/**< Define mode options, what type of argument it takes, and the callback */
+/**< fileformat values, in the order of eol_modes[] */
+static const gchar *const ff_choices[] = { "unix", "dos", "mac", NULL };
+
+/**< idlestyling values, in the order of the SC_IDLESTYLING_* constants */
+static const gchar *const idle_choices[] = { "none", "toview", "afterview", "all", NULL };
+
+/**< layoutcache values, in the order of the SC_CACHE_* constants */
+static const gchar *const cache_choices[] = { "none", "caret", "page", "document", NULL };
+
+/**< Define mode options, what type of argument it takes, and the callback.
+ *   Integer arguments are clamped to min..max, strings longer than max and
+ *   unknown enum values are dropped while parsing. */
 static struct mode_opt opts[] = {
-        { "expandtab",    "et",       MODE_OPT_ARG_TRUE,  &opt_expand_tab },
-        { "noexpandtab",  NULL,       MODE_OPT_ARG_FALSE, &opt_expand_tab },
-        { "tabstop",      "ts",       MODE_OPT_ARG_INT,   &opt_tab_stop },
-        { "softtabstop",  "sts",      MODE_OPT_ARG_INT,   &opt_tab_stop },
-        { "shiftwidth",   "sw",       MODE_OPT_ARG_INT,   &opt_tab_stop },
-        { "wrap",         NULL,       MODE_OPT_ARG_TRUE,  &opt_wrap },
-        { "nowrap",       NULL,       MODE_OPT_ARG_FALSE, &opt_wrap },
-        { "fileencoding", "encoding", MODE_OPT_ARG_STR,   &opt_enc },
-        { NULL,           NULL,       -1,                 NULL }
+        { "expandtab",      "et",       MODE_OPT_ARG_TRUE,  &opt_expand_tab,    0,                               0,  0,     NULL },
+        { "noexpandtab",    "noet",     MODE_OPT_ARG_FALSE, &opt_expand_tab,    0,                               0,  0,     NULL },
+        { "tabstop",        "ts",       MODE_OPT_ARG_INT,   &opt_tab_stop,      0,                               1,  32,    NULL },
+        { "softtabstop",    "sts",      MODE_OPT_ARG_INT,   &opt_tab_stop,      0,                               1,  32,    NULL },
+        { "shiftwidth",     "sw",       MODE_OPT_ARG_INT,   &opt_tab_stop,      0,                               1,  32,    NULL },
+        { "wrap",           NULL,       MODE_OPT_ARG_TRUE,  &opt_wrap,          0,                               0,  0,     NULL },
+        { "nowrap",         NULL,       MODE_OPT_ARG_FALSE, &opt_wrap,          0,                               0,  0,     NULL },
+        { "fileencoding",   "encoding", MODE_OPT_ARG_STR,   &opt_enc,           0,                               0,  32,    NULL },
+        { "filetype",       "ft",       MODE_OPT_ARG_STR,   &opt_filetype,      MODE_OPT_EARLY,                  0,  32,    NULL },
+        { "syntax",         "syn",      MODE_OPT_ARG_STR,   &opt_filetype,      MODE_OPT_EARLY,                  0,  32,    NULL },
+        { "nolexer",        NULL,       MODE_OPT_ARG_TRUE,  &opt_no_lexer,      MODE_OPT_EARLY | MODE_OPT_GEANY, 0,  0,     NULL },
+        { "fileformat",     "ff",       MODE_OPT_ARG_ENUM,  &opt_fileformat,    0,                               0,  0,     ff_choices },
+        { "idlestyling",    NULL,       MODE_OPT_ARG_ENUM,  &opt_idle_styling,  MODE_OPT_GEANY,                  0,  0,     idle_choices },
+        { "layoutcache",    NULL,       MODE_OPT_ARG_ENUM,  &opt_layout_cache,  MODE_OPT_GEANY,                  0,  0,     cache_choices },
+        { "caretline",      NULL,       MODE_OPT_ARG_TRUE,  &opt_caret_line,    MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "nocaretline",    NULL,       MODE_OPT_ARG_FALSE, &opt_caret_line,    MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "whitespace",     NULL,       MODE_OPT_ARG_TRUE,  &opt_whitespace,    MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "nowhitespace",   NULL,       MODE_OPT_ARG_FALSE, &opt_whitespace,    MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "indentguides",   NULL,       MODE_OPT_ARG_TRUE,  &opt_indent_guides, MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "noindentguides", NULL,       MODE_OPT_ARG_FALSE, &opt_indent_guides, MODE_OPT_GEANY,                  0,  0,     NULL },
+        { "foldenable",     "fen",      MODE_OPT_ARG_TRUE,  &opt_fold_enable,   0,                               0,  0,     NULL },
+        { "nofoldenable",   "nofen",    MODE_OPT_ARG_FALSE, &opt_fold_enable,   0,                               0,  0,     NULL },
+        { "foldlevel",      "fdl",      MODE_OPT_ARG_INT,   &opt_fold_level,    0,                               0,  99,    NULL },
+        { "readonly",       "ro",       MODE_OPT_ARG_TRUE,  &opt_readonly,      0,                               0,  0,     NULL },
+        { "noreadonly",     "noro",     MODE_OPT_ARG_FALSE, &opt_readonly,      0,                               0,  0,     NULL },
+        { "modifiable",     "ma",       MODE_OPT_ARG_TRUE,  &opt_modifiable,    0,                               0,  0,     NULL },
+        { "nomodifiable",   "noma",     MODE_OPT_ARG_FALSE, &opt_modifiable,    0,                               0,  0,     NULL },
+        { "undolevels",     "ul",       MODE_OPT_ARG_INT,   &opt_undo_levels,   0,                               -1, 10000, NULL },
+        { NULL,             NULL,       -1,                 NULL,               0,                               0,  0,     NULL }
+};
+
+/**
+ * @brief A parsed option, waiting to be applied to a document
+ */
+struct ml_setting {
+        const struct mode_opt *opt; /**< Option */
+        gint iarg; /**< Argument of non string options */
+        gchar *sarg; /**< Argument of MODE_OPT_ARG_STR options */
+};
+
+/**
+ * @brief Per-document modeline state
+ *
+ * Records what the last modeline applied to a document, so unchanged settings
+ * are not pushed to the editor again on every save.  Kept small and flat: the
+ * states live in a dense array indexed by doc->index.
+ */
+struct ml_state {
+        guint64 window_hash; /**< Hash of the scanned windows, if has_hash */
+        gint head_end; /**< Buffer position where the head window ends */
+        gint tail_start; /**< Buffer position where the tail window starts */
+        gint fold_line; /**< First line foldlevel has not looked at, if fold_pending */
+        guint doc_id; /**< doc->id of the owner, valid if in_use */
+        GQuark encoding; /**< Interned encoding the document is in by its modeline, 0 if none */
+        guint8 fold_level; /**< foldlevel to close folds at, if fold_pending */
+        guint in_use : 1; /**< Slot belongs to an open document */
+        guint need_reload : 1; /**< Encoding changed, reload pending */
+        guint has_hash : 1; /**< window_hash is set */
+        guint profiled : 1; /**< Large file profile was applied */
+        guint tracked : 1; /**< head_end and tail_start are set */
+        guint fold_pending : 1; /**< foldlevel waits for more text to be styled */
+};
+
+/**< Document states, indexed by doc->index */
+static GArray *ml_states;
+
+/**
+ * @brief Encoding alias structure
+ */
+struct ml_enc_alias {
+        const gchar *alias; /**< vim/Emacs/IANA spelling, normalized */
+        const gchar *charset; /**< Charset name as Geany knows it */
+};
+
+/**< Map encoding spellings to Geany charset names.  Aliases are written the
+ *   way ml_enc_normalize() leaves them: lowercase, no '-', '_' or blanks. */
+static const struct ml_enc_alias enc_aliases[] = {
+        { "utf8",           "UTF-8" },
+        { "utf7",           "UTF-7" },
+        { "utf16",          "UTF-16" },
+        { "ucs2",           "UTF-16" },
+        { "utf16le",        "UTF-16LE" },
+        { "ucs2le",         "UTF-16LE" },
+        { "utf16be",        "UTF-16BE" },
+        { "ucs2be",         "UTF-16BE" },
+        { "utf32",          "UTF-32" },
+        { "ucs4",           "UTF-32" },
+        { "utf32le",        "UTF-32LE" },
+        { "ucs4le",         "UTF-32LE" },
+        { "utf32be",        "UTF-32BE" },
+        { "ucs4be",         "UTF-32BE" },
+        { "ascii",          "ISO-8859-1" },
+        { "usascii",        "ISO-8859-1" },
+        { "latin1",         "ISO-8859-1" },
+        { "latin",          "ISO-8859-1" },
+        { "l1",             "ISO-8859-1" },
+        { "iso88591",       "ISO-8859-1" },
+        { "iso885915",      "ISO-8859-15" },
+        { "latin9",         "ISO-8859-15" },
+        { "latin2",         "ISO-8859-2" },
+        { "iso88592",       "ISO-8859-2" },
+        { "latin3",         "ISO-8859-3" },
+        { "iso88593",       "ISO-8859-3" },
+        { "latin4",         "ISO-8859-4" },
+        { "iso88594",       "ISO-8859-4" },
+        { "cyrillic",       "ISO-8859-5" },
+        { "iso88595",       "ISO-8859-5" },
+        { "arabic",         "ISO-8859-6" },
+        { "iso88596",       "ISO-8859-6" },
+        { "greek",          "ISO-8859-7" },
+        { "iso88597",       "ISO-8859-7" },
+        { "hebrew",         "ISO-8859-8" },
+        { "iso88598",       "ISO-8859-8" },
+        { "latin5",         "ISO-8859-9" },
+        { "iso88599",       "ISO-8859-9" },
+        { "latin6",         "ISO-8859-10" },
+        { "iso885910",      "ISO-8859-10" },
+        { "iso885913",      "ISO-8859-13" },
+        { "latin7",         "ISO-8859-13" },
+        { "iso885914",      "ISO-8859-14" },
+        { "latin8",         "ISO-8859-14" },
+        { "iso885916",      "ISO-8859-16" },
+        { "latin10",        "ISO-8859-16" },
+        { "cp1250",         "WINDOWS-1250" },
+        { "windows1250",    "WINDOWS-1250" },
+        { "cp1251",         "WINDOWS-1251" },
+        { "windows1251",    "WINDOWS-1251" },
+        { "cp1252",         "WINDOWS-1252" },
+        { "windows1252",    "WINDOWS-1252" },
+        { "cp1253",         "WINDOWS-1253" },
+        { "windows1253",    "WINDOWS-1253" },
+        { "cp1254",         "WINDOWS-1254" },
+        { "windows1254",    "WINDOWS-1254" },
+        { "cp1255",         "WINDOWS-1255" },
+        { "windows1255",    "WINDOWS-1255" },
+        { "cp1256",         "WINDOWS-1256" },
+        { "windows1256",    "WINDOWS-1256" },
+        { "cp1257",         "WINDOWS-1257" },
+        { "windows1257",    "WINDOWS-1257" },
+        { "cp1258",         "WINDOWS-1258" },
+        { "windows1258",    "WINDOWS-1258" },
+        { "cp866",          "CP866" },
+        { "ibm866",         "CP866" },
+        { "cp850",          "IBM850" },
+        { "ibm850",         "IBM850" },
+        { "cp852",          "IBM852" },
+        { "ibm852",         "IBM852" },
+        { "cp855",          "IBM855" },
+        { "ibm855",         "IBM855" },
+        { "cp862",          "IBM862" },
+        { "ibm862",         "IBM862" },
+        { "koi8r",          "KOI8-R" },
+        { "koi8u",          "KOI8-U" },
+        { "sjis",           "SHIFT_JIS" },
+        { "shiftjis",       "SHIFT_JIS" },
+        { "cp932",          "SHIFT_JIS" },
+        { "eucjp",          "EUC-JP" },
+        { "iso2022jp",      "ISO-2022-JP" },
+        { "euckr",          "EUC-KR" },
+        { "cp949",          "UHC" },
+        { "uhc",            "UHC" },
+        { "iso2022kr",      "ISO-2022-KR" },
+        { "euccn",          "GB2312" },
+        { "gb2312",         "GB2312" },
+        { "cp936",          "GBK" },
+        { "gbk",            "GBK" },
+        { "gb18030",        "GB18030" },
+        { "big5",           "BIG5" },
+        { "cp950",          "BIG5" },
+        { "big5hkscs",      "BIG5-HKSCS" },
+        { "euctw",          "EUC-TW" },
+        { "tis620",         "TIS-620" },
+        { "cp874",          "WINDOWS-874" },
+        { "windows874",     "WINDOWS-874" },
+        { NULL,             NULL }
+};
+
+/**< Normalized encoding spelling to charset quark, built at init */
+static GHashTable *enc_table;
+
+/**
+ * @brief Filetype alias structure
+ */
+struct ml_ft_alias {
+        const gchar *alias; /**< vim/Emacs filetype name, lowercase */
+        const gchar *name; /**< Geany filetype name */
+};
+
+/**< vim and Emacs filetype names which are not a Geany filetype name as is */
+static const struct ml_ft_alias ft_aliases[] = {
+        { "sh",            "Sh" },
+        { "bash",          "Sh" },
+        { "zsh",           "Sh" },
+        { "ksh",           "Sh" },
+        { "shell-script",  "Sh" },
+        { "cpp",           "C++" },
+        { "cxx",           "C++" },
+        { "cs",            "C#" },
+        { "csharp",        "C#" },
+        { "objc",          "Objective-C" },
+        { "make",          "Make" },
+        { "makefile",      "Make" },
+        { "automake",      "Make" },
+        { "py",            "Python" },
+        { "js",            "Javascript" },
+        { "javascript",    "Javascript" },
+        { "tex",           "LaTeX" },
+        { "plaintex",      "LaTeX" },
+        { "dosini",        "Conf" },
+        { "cfg",           "Conf" },
+        { "emacs-lisp",    "Lisp" },
+        { "elisp",         "Lisp" },
+        { "scheme",        "Lisp" },
+        { "asm",           "ASM" },
+        { "nasm",          "ASM" },
+        { "fortran",       "Fortran" },
+        { "f90",           "Fortran" },
+        { "f77",           "F77" },
+        { "pascal",        "Pascal" },
+        { "delphi",        "Pascal" },
+        { "rs",            "Rust" },
+        { "golang",        "Go" },
+        { "patch",         "Diff" },
+        { "text",          "None" },
+        { "txt",           "None" },
+        { "plain",         "None" },
+        { "fundamental",   "None" },
+        { NULL,            NULL }
+};
+
+/**< Lowercase filetype name or alias to GeanyFiletype, built at init */
+static GHashTable *ft_table;
+
+/**< Compiled path globs of documents to leave alone (GPatternSpec *) */
+static GPtrArray *skip_paths;
+
+/**< Documents above this many bytes are scanned from disk, not Scintilla */
+static gint64 large_file_size = ML_LARGE_FILE_SIZE;
+
+/**< Whether documents above large_file_size get the large file profile */
+static gboolean large_file_profile = TRUE;
+
+/**< ML_LARGE_FILE_PROFILE, parsed at init */
+static GArray *profile_settings;
+
+/**< Filetypes to leave alone, indexed by GeanyFiletype id */
+static guint8 *skip_filetypes;
+static guint n_skip_filetypes;
+
+/**
+ * @brief Background re-decode of a document's file
+ */
+struct ml_decode {
+        guint doc_id; /**< Document to fill */
+        gchar *path; /**< doc->real_path */
+        gchar *charset; /**< Encoding to decode from */
+        gchar *old_charset; /**< Encoding to restore if decoding fails */
+        gchar *text; /**< Decoded UTF-8 text */
+        gboolean has_bom; /**< Decoded text started with a BOM */
+};
+
+/**
+ * @brief Scan of one document, read in slices of ML_SLICE_BUDGET
+ */
+struct ml_scan {
+        guint doc_id; /**< Document */
+        guint flags; /**< enum ml_scan_flag */
+        gchar *old_enc; /**< Encoding before the scan, with ML_SCAN_OPEN */
+        GPtrArray *lines; /**< Window lines read from the buffer so far */
+        guint line; /**< Next buffer line to read */
+        guint count; /**< Lines of the buffer */
+        gchar **file_lines; /**< Window lines read from the file, for large documents */
+        gboolean reading; /**< A worker is reading the file */
+        gboolean cancelled; /**< Replaced or closed while reading, free when read */
+        gint64 start; /**< g_get_monotonic_time() when the scan was started, for the trace */
+};
+
+/**
+ * @brief What a modeline may follow in a filetype
+ */
+struct ml_comments {
+        gchar **tokens; /**< comment_single and comment_open */
+        gboolean star_lines; /**< Lines starting with "* " continue a C style block comment */
+};
+
+/**
+ * @brief One document of a batch pass over open documents
+ */
+struct ml_batch_item {
+        guint doc_id; /**< Document */
+        gchar *path; /**< File to read the windows from, for large documents */
+        gchar **lines; /**< Window lines */
+        struct ml_comments *comments; /**< Comments of the filetype, see comments_new() */
+        GArray *settings; /**< Parsed settings */
+        gboolean found; /**< A modeline was found */
+        gboolean cached; /**< Settings came from the cache, nothing to parse */
+        guint64 hash; /**< Hash of lines, or of the cached settings' windows */
+        gsize bytes; /**< Length of lines, unless cached */
+        struct ml_batch *batch; /**< Batch this item belongs to */
+};
+
+/**
+ * @brief Batch pass: windows are parsed in worker threads, then the results
+ *        are applied on the main loop in slices of ML_SLICE_BUDGET.
+ */
+struct ml_batch {
+        GPtrArray *items; /**< struct ml_batch_item, one per document */
+        gint pending; /**< Items not parsed yet */
+        guint next; /**< First item not applied yet */
+        guint applied; /**< Items applied that had a modeline */
+        gboolean cancelled; /**< Plugin was unloaded, do not apply */
+};
+
+/**
+ * @brief Parsed modeline of a file, kept while the file is unchanged on disk
+ */
+struct ml_cache_entry {
+        GArray *settings; /**< Parsed settings, empty if there is no modeline */
+        gchar *dir; /**< Watched directory of the file */
+        time_t mtime; /**< st_mtime of the file when it was parsed */
+        off_t size; /**< st_size of the file when it was parsed */
+        guint64 hash; /**< Window hash the settings were parsed from */
+        gboolean stale; /**< File changed on disk, parse again when needed */
+};
+
+/**
+ * @brief Directory watch shared by the cache entries of files in it
+ */
+struct ml_dir_watch {
+        GFileMonitor *monitor; /**< NULL if the directory cannot be watched */
+        guint refs; /**< Cache entries in this directory */
+};
+
+/**< Parsed modelines by real path (struct ml_cache_entry *) */
+static GHashTable *cache;
+
+/**< Watched directories by path (struct ml_dir_watch *) */
+static GHashTable *dir_watches;
+
+/**< Keys of the counters file, in the order of enum ml_counter */
+static const gchar *const counter_keys[] = {
+        "documents_scanned",
+        "bytes_inspected",
+        "modelines_found",
+        "options_applied",
+        "reloads_triggered",
+        "reloads_avoided",
+        "callback_usec",
+        "sci_messages",
+        "sci_messages_usec",
+        "sci_line_reads",
+        "sci_line_reads_usec",
+        "sci_queries",
+        "sci_queries_usec",
+        "sci_edits",
+        "sci_edits_usec",
+        "indent_calls",
+        "indent_usec",
+        "encoding_calls",
+        "encoding_usec",
+        "document_calls",
+        "document_usec",
+        NULL
 };
 
+/**< Counters since the counters file was created, enum ml_counter */
+static guint64 counters[ML_N_COUNTERS];
+
+/**< Timer writing the counters file */
+static guint counters_source;
+
+/**< Whether to record handled events, see trace_event() */
+static gboolean trace_enabled;
+
+/**< Open trace file, if trace_enabled */
+static FILE *trace_file;
+
+/**< Unfinished scans by doc->id (struct ml_scan *) */
+static GHashTable *scans;
+
+/**< Scans waiting for a slice */
+static GQueue scan_queue = G_QUEUE_INIT;
+
+/**< Idle source running scan slices */
+static guint scan_source;
+
+/**< Documents with edited windows, by doc->id, waiting for live_source */
+static GHashTable *live_dirty;
+
+/**< Debounce timer of live re-scans */
+static guint live_source;
+
+/**< Worker threads parsing batch items */
+static GThreadPool *parse_pool;
+
+/**< Batch in progress, if any */
+static struct ml_batch *batch_running;
+
+/**< Tools menu item */
+static GtkWidget *apply_all_item;
+
+#define GEANY_PREFIX " geany:" /**< Prefix of modelines for MODE_OPT_GEANY options */
+
 /**< These are prefixes we search for to determine what is a modeline */
 static const gchar *mode_pre[] = {
-        " geany:",
+        GEANY_PREFIX,
         " vi:",
         " vim:",
         " ex:",
@@ -71,234 +580,2886 @@ static const gchar *mode_pre[] = {
 };
 
 /**
- * @brief Whether or not to expand tabs to spaces
+ * @brief Get the state slot of a document, claiming it if it is free or still
+ *        holds a closed document which had the same index.
  *
  * @param doc Document
- * @param arg 1/0 (gint)
+ *
+ * @return State of the document
  */
-static void opt_expand_tab(GeanyDocument *doc, void *arg)
+static struct ml_state *ml_state_get(GeanyDocument *doc)
 {
-        gint *iarg;
+        struct ml_state *st;
 
-        iarg = arg;
+        if ((guint) doc->index >= ml_states->len)
+                g_array_set_size(ml_states, doc->index + 1);
 
-        debugf("opt_expand_tab: %d\n", *iarg);
+        st = &g_array_index(ml_states, struct ml_state, doc->index);
+        if (!st->in_use || st->doc_id != doc->id) {
+                memset(st, 0, sizeof(*st));
+                st->doc_id = doc->id;
+                st->in_use = 1;
+        }
 
-        editor_set_indent_type(doc->editor, (*iarg) ?
-                               GEANY_INDENT_TYPE_SPACES :
-                               GEANY_INDENT_TYPE_TABS);
+        return st;
 }
 
 /**
- * @brief This sets the indent/tab width
+ * @brief Get the state slot of a document without claiming it.
  *
  * @param doc Document
- * @param arg Indent/tab width (gint)
+ *
+ * @return State of the document, NULL if it has none
  */
-static void opt_tab_stop(GeanyDocument *doc, void *arg)
+static struct ml_state *ml_state_peek(GeanyDocument *doc)
 {
-        const GeanyIndentPrefs *prefs;
-        gint *iarg;
-
-        iarg = arg;
-        prefs = editor_get_indent_prefs(doc->editor);
+        struct ml_state *st;
 
-        debugf("opt_tab_stop: %d\n", *iarg);
+        if ((guint) doc->index >= ml_states->len)
+                return NULL;
 
-        editor_set_indent_width(doc->editor, *iarg);
-        editor_set_indent_type(doc->editor, prefs->type);
+        st = &g_array_index(ml_states, struct ml_state, doc->index);
+        return (st->in_use && st->doc_id == doc->id) ? st : NULL;
 }
 
 /**
- * @brief Whether or not to wrap lines
+ * @brief Release the state slot of a document.
  *
  * @param doc Document
- * @param arg 1/0 (gint)
  */
-static void opt_wrap(GeanyDocument *doc, void *arg)
+static void ml_state_clear(GeanyDocument *doc)
 {
-        gint *iarg;
+        struct ml_state *st;
 
-        iarg = arg;
+        if ((guint) doc->index >= ml_states->len)
+                return;
 
-        debugf("opt_wrap: %d\n", *iarg);
+        st = &g_array_index(ml_states, struct ml_state, doc->index);
+        if (st->in_use && st->doc_id == doc->id)
+                memset(st, 0, sizeof(*st));
+}
 
-        doc->editor->line_wrapping = *iarg;
-        scintilla_send_message(doc->editor->sci, SCI_SETWRAPMODE,
-                               (*iarg) ? SC_WRAP_WORD : SC_WRAP_NONE, 0);
+/**
+ * @brief Normalize an encoding spelling for alias lookups: lowercase, with
+ *        '-', '_' and blanks dropped.
+ *
+ * @param enc Encoding name
+ * @param buf Output buffer
+ * @param len Size of buf
+ *
+ * @return TRUE if the name fit into buf
+ */
+static gboolean ml_enc_normalize(const gchar *enc, gchar *buf, gsize len)
+{
+        gsize n = 0;
+
+        for (; *enc; enc++) {
+                if (*enc == '-' || *enc == '_' || g_ascii_isspace(*enc))
+                        continue;
+                if (n + 1 >= len)
+                        return FALSE;
+                buf[n++] = g_ascii_tolower(*enc);
+        }
+        buf[n] = '\0';
+
+        return TRUE;
 }
 
 /**
- * @brief This sets specified file encoding
+ * @brief Map an encoding spelling from a modeline to the charset name Geany
+ *        uses.  Unknown names are passed through, uppercased.
  *
- * @param doc Document
- * @param arg encoding (gchar *)
+ * @param enc Encoding name
+ *
+ * @return Interned charset name
  */
-static void opt_enc(GeanyDocument *doc, void *arg)
+static GQuark ml_enc_canonical(const gchar *enc)
 {
-        const gchar *str = arg;
+        gchar key[32], *up;
+        gpointer q;
+        GQuark ret;
 
-        debugf("opt_enc: \"%s\"\n", str);
+        if (ml_enc_normalize(enc, key, sizeof(key)) &&
+            (q = g_hash_table_lookup(enc_table, key)))
+                return GPOINTER_TO_UINT(q);
 
-        document_set_encoding(doc, str);
+        up = g_ascii_strup(enc, -1);
+        ret = g_quark_from_string(up);
+        g_free(up);
 
-        debugf("Setting \"%s\"\n", doc->encoding);
+        return ret;
 }
 
 /**
- * @brief Scan a document, line by line, looking for modelines.
+ * @brief Read the plugin configuration and compile the skip rules.
  *
- * @param doc Document
+ * The configuration lives in plugins/modeline/modeline.conf in Geany's
+ * configuration directory:
+ *
+ *   [modeline]
+ *   skip_paths=*.log;*.min.js;
+ *   skip_filetypes=None;Diff;
+ *   large_file_size=16777216
+ *   large_file_profile=true
+ *   trace=false
  */
-static void scan_document(GeanyDocument *doc)
+static void ml_load_config(void)
 {
-        guint lines, line, i;
-        gchar *buf, *ptr;
+        GKeyFile *kf;
+        GError *err = NULL;
+        gchar *path, **list;
+        GeanyFiletype *ft;
+        gint64 size;
+        guint i;
 
-        if (!doc->is_valid)
+        skip_paths = g_ptr_array_new_with_free_func((GDestroyNotify) g_pattern_spec_free);
+        n_skip_filetypes = filetypes_array->len;
+        skip_filetypes = g_new0(guint8, n_skip_filetypes);
+
+        kf = g_key_file_new();
+        path = g_build_filename(geany_data->app->configdir, "plugins", "modeline",
+                                "modeline.conf", NULL);
+        if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL)) {
+                g_key_file_free(kf);
+                g_free(path);
                 return;
+        }
 
-        lines = sci_get_line_count(doc->editor->sci);
-        for (line = 0; line < MIN(lines, 50); line++) {
-                buf = g_strstrip(sci_get_line(doc->editor->sci, line));
+        if ((list = g_key_file_get_string_list(kf, "modeline", "skip_paths", NULL, NULL))) {
+                for (i = 0; list[i]; i++) {
+                        if (*g_strstrip(list[i]))
+                                g_ptr_array_add(skip_paths, g_pattern_spec_new(list[i]));
+                }
+                g_strfreev(list);
+        }
 
-                for (i = 0; mode_pre[i] != NULL; i++) {
-                        if ((ptr = g_strstr_len(buf, -1, mode_pre[i]))) {
-                                parse_options(doc, buf);
-                                return;
-                        }
+        if ((list = g_key_file_get_string_list(kf, "modeline", "skip_filetypes", NULL, NULL))) {
+                for (i = 0; list[i]; i++) {
+                        ft = filetypes_lookup_by_name(g_strstrip(list[i]));
+                        if (ft && (guint) ft->id < n_skip_filetypes)
+                                skip_filetypes[ft->id] = 1;
+                        else if (*list[i])
+                                g_warning("modeline: unknown filetype \"%s\" in %s", list[i], path);
                 }
+                g_strfreev(list);
         }
+
+        // A typo must not make every document large
+        if (g_key_file_has_key(kf, "modeline", "large_file_size", NULL)) {
+                size = g_key_file_get_int64(kf, "modeline", "large_file_size", &err);
+                if (!err && size > 0)
+                        large_file_size = size;
+                else
+                        g_warning("modeline: invalid large_file_size in %s, using %" G_GINT64_FORMAT,
+                                  path, large_file_size);
+                g_clear_error(&err);
+        }
+        if (g_key_file_has_key(kf, "modeline", "large_file_profile", NULL))
+                large_file_profile = g_key_file_get_boolean(kf, "modeline", "large_file_profile", NULL);
+        trace_enabled = g_key_file_get_boolean(kf, "modeline", "trace", NULL);
+
+        g_key_file_free(kf);
+        g_free(path);
 }
 
 /**
- * @brief Parse out each key/value pair from a modeline, then send the pair out
- *        to the option interpreter.
+ * @brief Path of the counters file, under the user's cache directory.
  *
- * @param doc Document
- * @param buf Modeline
+ * @return Path, free with g_free()
  */
-static void parse_options(GeanyDocument *doc, gchar *buf)
+static gchar *counters_path(void)
 {
-        gchar **tok;
-        guint i;
+        return g_build_filename(g_get_user_cache_dir(), "geany", "modeline", "counters", NULL);
+}
 
-        debugf("modeline [%s]\n", buf);
+/**
+ * @brief Continue counting from the totals of earlier sessions.
+ */
+static void counters_load(void)
+{
+        GKeyFile *kf;
+        gchar *path;
+        guint i;
 
-        // XXX Spaces not allowed around = character...
-        // Can be separated by colon, space and comma
-        tok = g_strsplit_set(buf, ": ,", 0);  // tok[0] is the "comment sign" therefore omited
-        for (i = 1; tok[i]; i++) {
-                if (tok[i])  // Skip empty parts
-                        interpret_option(doc, tok[i]);
+        kf = g_key_file_new();
+        path = counters_path();
+        if (g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL)) {
+                for (i = 0; counter_keys[i]; i++)
+                        counters[i] = g_key_file_get_uint64(kf, "counters", counter_keys[i], NULL);
         }
-        g_strfreev(tok);
+        g_key_file_free(kf);
+        g_free(path);
 }
 
 /**
- * @brief Interpret an option and set it.
- *
- * @param doc Document
- * @param opt Key/value pair
+ * @brief Write the counters file.  The file is replaced atomically, so a
+ *        reader never sees it half written.
  */
-static void interpret_option(GeanyDocument *doc, gchar *opt)
+static void counters_save(void)
 {
-        gchar **kv, *key, *val;
+        GKeyFile *kf;
+        GError *err = NULL;
+        gchar *path, *dir, *data;
+        gsize len;
         guint i;
-        gint iarg;
 
-        debugf("interpret [%s]\n", opt);
+        kf = g_key_file_new();
+        for (i = 0; counter_keys[i]; i++)
+                g_key_file_set_uint64(kf, "counters", counter_keys[i], counters[i]);
+        data = g_key_file_to_data(kf, &len, NULL);
 
-        if ((kv = g_strsplit(opt, "=", 2))) {
-                key = kv[0];
-                val = kv[1];
-                if (!key || !val) {
-                        g_strfreev(kv);
-                        return;  // Starts or ends with = character
-                }
-        } else {
-                key = opt;
-                val = NULL;
+        path = counters_path();
+        dir = g_path_get_dirname(path);
+        g_mkdir_with_parents(dir, 0700);
+        if (!g_file_set_contents(path, data, len, &err)) {
+                debugf("counters: %s\n", err->message);
+                g_error_free(err);
         }
 
-        for (i = 0; opts[i].name; i++) {
-                // name matched OR alias is not NULL AND mached else skip
-                if (!g_ascii_strcasecmp(opts[i].name, key) ||
-                        (opts[i].alias && !g_ascii_strcasecmp(opts[i].alias, key))) {
+        g_free(dir);
+        g_free(path);
+        g_free(data);
+        g_key_file_free(kf);
+}
 
-                        switch (opts[i].arg_type) {
-                        case MODE_OPT_ARG_TRUE:
-                                iarg = 1;
-                                opts[i].cb(doc, &iarg);
-                                break;
-                        case MODE_OPT_ARG_FALSE:
-                                iarg = 0;
-                                opts[i].cb(doc, &iarg);
-                                break;
-                        case MODE_OPT_ARG_INT:
-                                if (val) {
-                                        iarg = g_ascii_strtoull(g_strstrip(val), NULL, 10);
-                                        opts[i].cb(doc, &iarg);
-                                }
-                                break;
-                        case MODE_OPT_ARG_STR:
-                                if (val)
-                                        opts[i].cb(doc, val);
-                                break;
-                        }
+/**
+ * @brief Timer: write the counters file.
+ *
+ * @param data
+ *
+ * @return G_SOURCE_CONTINUE
+ */
+static gboolean counters_tick(gpointer data)
+{
+        counters_save();
+        if (trace_file)
+                fflush(trace_file);
+        return G_SOURCE_CONTINUE;
+}
 
-                        g_strfreev(kv);
-                        return;
-                }
-        }
+/**
+ * @brief Open the trace file for appending, if tracing is enabled.
+ */
+static void trace_open(void)
+{
+        gchar *path, *dir;
+
+        if (!trace_enabled)
+                return;
+
+        path = g_build_filename(g_get_user_cache_dir(), "geany", "modeline", "trace", NULL);
+        dir = g_path_get_dirname(path);
+        g_mkdir_with_parents(dir, 0700);
+        if (!(trace_file = fopen(path, "a")))
+                g_warning("modeline: cannot open %s for tracing", path);
+
+        g_free(dir);
+        g_free(path);
 }
 
 /**
- * @brief Document open hook
+ * @brief Record a handled open or save in the trace file, one line per
+ *        event: event, wall clock time and the time until the document was
+ *        done with (both in microseconds), buffer size in bytes and the
+ *        escaped real path.
  *
- * @param obj
+ * @param flags enum ml_scan_flag of the scan, nothing is recorded for
+ *        scans not started by an open or a save
  * @param doc Document
- * @param user_data
+ * @param start g_get_monotonic_time() when the event was handled
  */
-static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer user_data)
+static void trace_event(guint flags, GeanyDocument *doc, gint64 start)
 {
-        scan_document(doc);
-        document_reload_force(doc, doc->encoding);  // We set this in scan_document function
+        const gchar *event;
+        gchar *path;
+
+        if (!trace_file)
+                return;
+
+        if (flags & ML_SCAN_OPEN)
+                event = "open";
+        else if (flags & ML_SCAN_SAVE)
+                event = "save";
+        else
+                return;
+
+        path = g_strescape(doc->real_path ? doc->real_path : "", NULL);
+        fprintf(trace_file, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%d\t%s\n",
+                event, g_get_real_time(), g_get_monotonic_time() - start,
+                ml_sci_get_length(doc->editor->sci), path);
+        g_free(path);
 }
 
 /**
- * @brief Document save hook
+ * @brief Add the time since a callback started to the callback time.
  *
- * @param obj
- * @param doc Document
- * @param user_data
+ * @param start g_get_monotonic_time() when the callback started
  */
-static void on_document_save(GObject *obj, GeanyDocument *doc, gpointer user_data)
+static void counters_time(gint64 start)
 {
-        scan_document(doc);
+        counters[ML_COUNT_CALLBACK_USEC] += g_get_monotonic_time() - start;
 }
 
 /**
- * @brief Plugin initialization
+ * @brief Count an editor call and the time it took.
  *
- * @param plugin
- * @param data
+ * @param counter Call counter, its time counter follows it
+ * @param start g_get_monotonic_time() before the call
  */
-static gboolean MLplugin_init(GeanyPlugin *plugin, gpointer data)
+static void counters_call(enum ml_counter counter, gint64 start)
 {
-        geany_plugin = plugin;
-        geany_data = plugin->geany_data;
-        return TRUE;
+        counters[counter]++;
+        counters[counter + 1] += g_get_monotonic_time() - start;
 }
 
 /**
- * @brief Plugin cleanup
+ * @brief Counted and timed scintilla_send_message()
  *
- * @param plugin
- * @param data
+ * Every call the plugin makes into the editor goes through one of the ml_
+ * wrappers, so the counters show what scanning and applying cost on the
+ * editor's side.  Time spent in hooks that a call triggers, e.g.
+ * document-reload during document_reload_force(), is included.
+ */
+static sptr_t ml_sci_send(ScintillaObject *sci, guint msg, uptr_t wparam, sptr_t lparam)
+{
+        gint64 start = g_get_monotonic_time();
+        sptr_t ret;
+
+        ret = scintilla_send_message(sci, msg, wparam, lparam);
+        counters_call(ML_COUNT_SCI_MESSAGES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_get_line()
+ */
+static gchar *ml_sci_get_line(ScintillaObject *sci, gint line)
+{
+        gint64 start = g_get_monotonic_time();
+        gchar *ret;
+
+        ret = sci_get_line(sci, line);
+        counters_call(ML_COUNT_SCI_LINES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_get_line_count()
+ */
+static gint ml_sci_get_line_count(ScintillaObject *sci)
+{
+        gint64 start = g_get_monotonic_time();
+        gint ret;
+
+        ret = sci_get_line_count(sci);
+        counters_call(ML_COUNT_SCI_LINES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_get_length()
+ */
+static gint ml_sci_get_length(ScintillaObject *sci)
+{
+        gint64 start = g_get_monotonic_time();
+        gint ret;
+
+        ret = sci_get_length(sci);
+        counters_call(ML_COUNT_SCI_QUERIES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_get_position_from_line()
+ */
+static gint ml_sci_get_position_from_line(ScintillaObject *sci, gint line)
+{
+        gint64 start = g_get_monotonic_time();
+        gint ret;
+
+        ret = sci_get_position_from_line(sci, line);
+        counters_call(ML_COUNT_SCI_QUERIES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_get_current_position()
  */
-void MLplugin_cleanup(GeanyPlugin *plugin, gpointer data)
+static gint ml_sci_get_current_position(ScintillaObject *sci)
 {
+        gint64 start = g_get_monotonic_time();
+        gint ret;
+
+        ret = sci_get_current_position(sci);
+        counters_call(ML_COUNT_SCI_QUERIES, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed sci_set_text()
+ */
+static void ml_sci_set_text(ScintillaObject *sci, const gchar *text)
+{
+        gint64 start = g_get_monotonic_time();
+
+        sci_set_text(sci, text);
+        counters_call(ML_COUNT_SCI_EDITS, start);
+}
+
+/**
+ * @brief Counted and timed sci_set_readonly()
+ */
+static void ml_sci_set_readonly(ScintillaObject *sci, gboolean readonly)
+{
+        gint64 start = g_get_monotonic_time();
+
+        sci_set_readonly(sci, readonly);
+        counters_call(ML_COUNT_SCI_EDITS, start);
+}
+
+/**
+ * @brief Counted and timed sci_set_current_position()
+ */
+static void ml_sci_set_current_position(ScintillaObject *sci, gint pos, gboolean scroll)
+{
+        gint64 start = g_get_monotonic_time();
+
+        sci_set_current_position(sci, pos, scroll);
+        counters_call(ML_COUNT_SCI_EDITS, start);
+}
+
+/**
+ * @brief Counted and timed editor_get_indent_prefs()
+ */
+static const GeanyIndentPrefs *ml_editor_get_indent_prefs(GeanyEditor *editor)
+{
+        gint64 start = g_get_monotonic_time();
+        const GeanyIndentPrefs *ret;
+
+        ret = editor_get_indent_prefs(editor);
+        counters_call(ML_COUNT_INDENT, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed editor_set_indent_type()
+ */
+static void ml_editor_set_indent_type(GeanyEditor *editor, GeanyIndentType type)
+{
+        gint64 start = g_get_monotonic_time();
+
+        editor_set_indent_type(editor, type);
+        counters_call(ML_COUNT_INDENT, start);
+}
+
+/**
+ * @brief Counted and timed editor_set_indent_width()
+ */
+static void ml_editor_set_indent_width(GeanyEditor *editor, gint width)
+{
+        gint64 start = g_get_monotonic_time();
+
+        editor_set_indent_width(editor, width);
+        counters_call(ML_COUNT_INDENT, start);
+}
+
+/**
+ * @brief Counted and timed document_set_encoding()
+ */
+static void ml_document_set_encoding(GeanyDocument *doc, const gchar *enc)
+{
+        gint64 start = g_get_monotonic_time();
+
+        document_set_encoding(doc, enc);
+        counters_call(ML_COUNT_ENCODING, start);
+}
+
+/**
+ * @brief Counted and timed document_reload_force()
+ */
+static gboolean ml_document_reload_force(GeanyDocument *doc, const gchar *enc)
+{
+        gint64 start = g_get_monotonic_time();
+        gboolean ret;
+
+        ret = document_reload_force(doc, enc);
+        counters_call(ML_COUNT_ENCODING, start);
+        return ret;
+}
+
+/**
+ * @brief Counted and timed document_set_filetype()
+ */
+static void ml_document_set_filetype(GeanyDocument *doc, GeanyFiletype *ft)
+{
+        gint64 start = g_get_monotonic_time();
+
+        document_set_filetype(doc, ft);
+        counters_call(ML_COUNT_DOCUMENT, start);
+}
+
+/**
+ * @brief Counted and timed document_set_text_changed()
+ */
+static void ml_document_set_text_changed(GeanyDocument *doc, gboolean changed)
+{
+        gint64 start = g_get_monotonic_time();
+
+        document_set_text_changed(doc, changed);
+        counters_call(ML_COUNT_DOCUMENT, start);
+}
+
+/**
+ * @brief Whether a document is excluded from modeline processing by the
+ *        skip rules.
+ *
+ * @param doc Document
+ *
+ * @return TRUE to leave the document alone
+ */
+static gboolean ml_skip_document(GeanyDocument *doc)
+{
+        guint i;
+
+        if (doc->file_type && (guint) doc->file_type->id < n_skip_filetypes &&
+            skip_filetypes[doc->file_type->id])
+                return TRUE;
+
+        if (doc->file_name) {
+                for (i = 0; i < skip_paths->len; i++) {
+                        if (g_pattern_match_string(g_ptr_array_index(skip_paths, i), doc->file_name))
+                                return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * @brief Whether or not to expand tabs to spaces
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_expand_tab(GeanyDocument *doc, void *arg)
+{
+        GeanyIndentType type;
+        gint *iarg;
+
+        iarg = arg;
+        type = (*iarg) ? GEANY_INDENT_TYPE_SPACES : GEANY_INDENT_TYPE_TABS;
+
+        debugf("opt_expand_tab: %d\n", *iarg);
+
+        // The user may have changed it from the menus since
+        if (ml_editor_get_indent_prefs(doc->editor)->type == type)
+                return;
+
+        ml_editor_set_indent_type(doc->editor, type);
+}
+
+/**
+ * @brief This sets the indent/tab width
+ *
+ * @param doc Document
+ * @param arg Indent/tab width (gint)
+ */
+static void opt_tab_stop(GeanyDocument *doc, void *arg)
+{
+        const GeanyIndentPrefs *prefs;
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_tab_stop: %d\n", *iarg);
+
+        prefs = ml_editor_get_indent_prefs(doc->editor);
+        if (prefs->width == *iarg)
+                return;
+
+        ml_editor_set_indent_width(doc->editor, *iarg);
+        ml_editor_set_indent_type(doc->editor, prefs->type);
+}
+
+/**
+ * @brief Make wrapping a large document cheap to start: only lay out what is
+ *        visible right away and leave the rest to Scintilla's idle time.
+ *
+ * @param sci Editor
+ */
+static void large_doc_layout(ScintillaObject *sci)
+{
+        ml_sci_send(sci, SCI_SETLAYOUTCACHE, SC_CACHE_PAGE, 0);
+        ml_sci_send(sci, SCI_SETPOSITIONCACHE, 1024, 0);
+#ifdef SCI_SETIDLESTYLING
+        ml_sci_send(sci, SCI_SETIDLESTYLING, SC_IDLESTYLING_AFTERVISIBLE, 0);
+#endif
+#ifdef SCI_SETLAYOUTTHREADS
+        ml_sci_send(sci, SCI_SETLAYOUTTHREADS, g_get_num_processors(), 0);
+#endif
+}
+
+/**
+ * @brief Whether or not to wrap lines
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_wrap(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_wrap: %d\n", *iarg);
+
+        if (!doc->editor->line_wrapping == !(*iarg))
+                return;
+
+        if (*iarg && ml_sci_get_length(doc->editor->sci) > large_file_size)
+                large_doc_layout(doc->editor->sci);
+
+        doc->editor->line_wrapping = *iarg;
+        ml_sci_send(doc->editor->sci, SCI_SETWRAPMODE,
+                    (*iarg) ? SC_WRAP_WORD : SC_WRAP_NONE, 0);
+}
+
+/**
+ * @brief This sets specified file encoding
+ *
+ * @param doc Document
+ * @param arg encoding (gchar *)
+ */
+static void opt_enc(GeanyDocument *doc, void *arg)
+{
+        const gchar *str = arg;
+        struct ml_state *st;
+        GQuark enc;
+
+        st = ml_state_get(doc);
+        enc = ml_enc_canonical(str);
+
+        debugf("opt_enc: \"%s\" -> \"%s\"\n", str, g_quark_to_string(enc));
+
+        // Already in it, by this modeline before or by another spelling
+        if (doc->encoding && !g_ascii_strcasecmp(doc->encoding, g_quark_to_string(enc))) {
+                if (st->encoding != enc)
+                        counters[ML_COUNT_RELOADS_AVOIDED]++;
+                st->encoding = enc;
+                return;
+        }
+        st->encoding = enc;
+        st->need_reload = 1;
+
+        ml_document_set_encoding(doc, g_quark_to_string(enc));
+
+        debugf("Setting \"%s\"\n", doc->encoding);
+}
+
+/**
+ * @brief Free the string argument of a parsed setting
+ *
+ * @param data Setting (struct ml_setting *)
+ */
+static void setting_clear(gpointer data)
+{
+        struct ml_setting *set = data;
+
+        g_free(set->sarg);
+}
+
+/**
+ * @brief Create an empty list of parsed settings
+ *
+ * @return Array of struct ml_setting
+ */
+static GArray *settings_new(void)
+{
+        GArray *settings;
+
+        settings = g_array_new(FALSE, FALSE, sizeof(struct ml_setting));
+        g_array_set_clear_func(settings, setting_clear);
+
+        return settings;
+}
+
+/**
+ * @brief Apply one parsed setting by calling its option callback.
+ *
+ * @param doc Document
+ * @param set Setting
+ */
+static void apply_setting(GeanyDocument *doc, struct ml_setting *set)
+{
+        counters[ML_COUNT_APPLIED]++;
+
+        if (set->opt->arg_type == MODE_OPT_ARG_STR)
+                set->opt->cb(doc, set->sarg);
+        else
+                set->opt->cb(doc, &set->iarg);
+}
+
+/**
+ * @brief Apply parsed settings to a document by calling the option callbacks.
+ *
+ * @param doc Document
+ * @param settings Array of struct ml_setting
+ */
+static void apply_settings(GeanyDocument *doc, GArray *settings)
+{
+        struct ml_setting *set;
+        gboolean early;
+        guint pass, i;
+
+        // MODE_OPT_EARLY options first, e.g. the filetype before indentation
+        for (pass = 0; pass < 2; pass++) {
+                for (i = 0; i < settings->len; i++) {
+                        set = &g_array_index(settings, struct ml_setting, i);
+                        early = (set->opt->flags & MODE_OPT_EARLY) != 0;
+                        if (early != (pass == 0))
+                                continue;
+
+                        apply_setting(doc, set);
+                }
+        }
+}
+
+/**
+ * @brief Apply the large file profile to a document above large_file_size,
+ *        once.  Profile options set by the document's own modeline are left
+ *        to the modeline.
+ *
+ * @param doc Document
+ * @param settings The document's parsed modeline
+ */
+static void apply_profile(GeanyDocument *doc, GArray *settings)
+{
+        struct ml_setting *set;
+        struct ml_state *st;
+        guint i, j;
+
+        if (!large_file_profile || ml_sci_get_length(doc->editor->sci) <= large_file_size)
+                return;
+
+        st = ml_state_get(doc);
+        if (st->profiled)
+                return;
+        st->profiled = 1;
+
+        debugf("profile: large document\n");
+
+        for (i = 0; i < profile_settings->len; i++) {
+                set = &g_array_index(profile_settings, struct ml_setting, i);
+                for (j = 0; j < settings->len; j++) {
+                        if (g_array_index(settings, struct ml_setting, j).opt->cb == set->opt->cb)
+                                break;
+                }
+                if (j == settings->len)
+                        apply_setting(doc, set);
+        }
+}
+
+/**
+ * @brief Apply a document's parsed modeline, after the large file profile if
+ *        the document is large.
+ *
+ * @param doc Document
+ * @param settings Array of struct ml_setting
+ */
+static void apply_document(GeanyDocument *doc, GArray *settings)
+{
+        apply_profile(doc, settings);
+        apply_settings(doc, settings);
+}
+
+/**
+ * @brief Copy a list of parsed settings
+ *
+ * @param settings Array of struct ml_setting
+ *
+ * @return New array of struct ml_setting
+ */
+static GArray *settings_copy(GArray *settings)
+{
+        struct ml_setting set;
+        GArray *copy;
+        guint i;
+
+        copy = settings_new();
+        for (i = 0; i < settings->len; i++) {
+                set = g_array_index(settings, struct ml_setting, i);
+                set.sarg = g_strdup(set.sarg);
+                g_array_append_val(copy, set);
+        }
+
+        return copy;
+}
+
+/**
+ * @brief Directory monitor callback: mark the cache entries of changed files
+ *        stale.  They are parsed again the next time they are needed.
+ *
+ * @param monitor
+ * @param file Changed file
+ * @param other New name of a renamed file
+ * @param event
+ * @param user_data
+ */
+static void on_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+                           GFileMonitorEvent event, gpointer user_data)
+{
+        struct ml_cache_entry *entry;
+        GFile *files[2] = { file, other };
+        gchar *path;
+        guint i;
+
+        if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+                return;
+
+        for (i = 0; i < G_N_ELEMENTS(files); i++) {
+                if (!files[i] || !(path = g_file_get_path(files[i])))
+                        continue;
+                if ((entry = g_hash_table_lookup(cache, path)) && !entry->stale) {
+                        debugf("cache: %s changed on disk\n", path);
+                        entry->stale = TRUE;
+                }
+                g_free(path);
+        }
+}
+
+/**
+ * @brief Free a directory watch
+ *
+ * @param data Watch (struct ml_dir_watch *)
+ */
+static void dir_watch_free(gpointer data)
+{
+        struct ml_dir_watch *watch = data;
+
+        if (watch->monitor) {
+                g_file_monitor_cancel(watch->monitor);
+                g_object_unref(watch->monitor);
+        }
+        g_slice_free(struct ml_dir_watch, watch);
+}
+
+/**
+ * @brief Start watching a directory, or take another reference on its watch.
+ *
+ * @param dir Directory
+ *
+ * @return Watch of the directory
+ */
+static struct ml_dir_watch *dir_watch_ref(const gchar *dir)
+{
+        struct ml_dir_watch *watch;
+        GFile *file;
+
+        if (!(watch = g_hash_table_lookup(dir_watches, dir))) {
+                watch = g_slice_new0(struct ml_dir_watch);
+                file = g_file_new_for_path(dir);
+                watch->monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES,
+                                                          NULL, NULL);
+                g_object_unref(file);
+                if (watch->monitor)
+                        g_signal_connect(watch->monitor, "changed", G_CALLBACK(on_dir_changed), NULL);
+                g_hash_table_insert(dir_watches, g_strdup(dir), watch);
+        }
+        watch->refs++;
+
+        return watch;
+}
+
+/**
+ * @brief Drop a reference on a directory watch, stop watching at zero.
+ *
+ * @param dir Directory
+ */
+static void dir_watch_unref(const gchar *dir)
+{
+        struct ml_dir_watch *watch;
+
+        if ((watch = g_hash_table_lookup(dir_watches, dir)) && !--watch->refs)
+                g_hash_table_remove(dir_watches, dir);
+}
+
+/**
+ * @brief Free a cache entry and release its directory watch
+ *
+ * @param data Entry (struct ml_cache_entry *)
+ */
+static void cache_entry_free(gpointer data)
+{
+        struct ml_cache_entry *entry = data;
+
+        dir_watch_unref(entry->dir);
+        g_free(entry->dir);
+        g_array_free(entry->settings, TRUE);
+        g_slice_free(struct ml_cache_entry, entry);
+}
+
+/**
+ * @brief Look up the parsed modeline of a file.
+ *
+ * @param path Real path of the file, may be NULL
+ * @param hash Set to the window hash the settings were parsed from
+ *
+ * @return Settings, NULL if not cached or changed on disk since
+ */
+static GArray *cache_lookup(const gchar *path, guint64 *hash)
+{
+        struct ml_cache_entry *entry;
+        struct stat sb;
+
+        if (!path || !(entry = g_hash_table_lookup(cache, path)) || entry->stale)
+                return NULL;
+
+        // The monitor event of a file rewritten just now may still be queued
+        if (stat(path, &sb) || sb.st_mtime != entry->mtime || sb.st_size != entry->size) {
+                debugf("cache: %s changed on disk\n", path);
+                entry->stale = TRUE;
+                return NULL;
+        }
+
+        *hash = entry->hash;
+        return entry->settings;
+}
+
+/**
+ * @brief Remember the parsed modeline of a file.  Files in directories which
+ *        cannot be watched are not cached.
+ *
+ * @param path Real path of the file, may be NULL
+ * @param settings Settings, ownership is taken
+ * @param hash Window hash the settings were parsed from
+ */
+static void cache_store(const gchar *path, GArray *settings, guint64 hash)
+{
+        struct ml_cache_entry *entry;
+        struct ml_dir_watch *watch;
+        GHashTableIter iter;
+        struct stat sb;
+        gchar *dir;
+
+        if (!path || stat(path, &sb)) {
+                g_array_free(settings, TRUE);
+                return;
+        }
+
+        // Make room: drop stale entries first, everything if that is not enough
+        if (g_hash_table_size(cache) >= ML_CACHE_MAX && !g_hash_table_contains(cache, path)) {
+                g_hash_table_iter_init(&iter, cache);
+                while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry)) {
+                        if (entry->stale)
+                                g_hash_table_iter_remove(&iter);
+                }
+                if (g_hash_table_size(cache) >= ML_CACHE_MAX)
+                        g_hash_table_remove_all(cache);
+        }
+
+        dir = g_path_get_dirname(path);
+        watch = dir_watch_ref(dir);
+        if (!watch->monitor) {
+                dir_watch_unref(dir);
+                g_free(dir);
+                g_array_free(settings, TRUE);
+                return;
+        }
+
+        entry = g_slice_new0(struct ml_cache_entry);
+        entry->settings = settings;
+        entry->dir = dir;
+        entry->mtime = sb.st_mtime;
+        entry->size = sb.st_size;
+        entry->hash = hash;
+        g_hash_table_replace(cache, g_strdup(path), entry);
+}
+
+/**
+ * @brief Mix bytes into a 64 bit hash, eight at a time.  Not cryptographic,
+ *        just quick, in the style of xxHash.
+ *
+ * @param h Hash so far
+ * @param p Bytes
+ * @param len Number of bytes
+ *
+ * @return Updated hash
+ */
+static guint64 hash_bytes(guint64 h, const gchar *p, gsize len)
+{
+        const guint64 p1 = G_GUINT64_CONSTANT(0x9E3779B185EBCA87);
+        const guint64 p2 = G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F);
+        guint64 w;
+
+        for (; len >= 8; p += 8, len -= 8) {
+                memcpy(&w, p, 8);
+                h ^= w * p2;
+                h = ((h << 31) | (h >> 33)) * p1;
+        }
+
+        w = 0;
+        memcpy(&w, p, len);
+        h ^= (w ^ len) * p2;
+        h = ((h << 31) | (h >> 33)) * p1;
+
+        return h;
+}
+
+/**
+ * @brief Hash window lines, so an unchanged modeline can be told apart from
+ *        a changed one without parsing it.
+ *
+ * @param lines NULL terminated lines
+ * @param bytes Set to the length of the lines
+ *
+ * @return Hash
+ */
+static guint64 window_hash(gchar **lines, gsize *bytes)
+{
+        guint64 h = 0;
+        gsize len;
+        guint i;
+
+        *bytes = 0;
+
+        // Hash the terminating NUL too, it separates the lines
+        for (i = 0; lines[i]; i++) {
+                len = strlen(lines[i]);
+                h = hash_bytes(h, lines[i], len + 1);
+                *bytes += len;
+        }
+
+        h ^= h >> 33;
+        h *= G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F);
+        h ^= h >> 29;
+        h *= G_GUINT64_CONSTANT(0x165667B19E3779F9);
+        h ^= h >> 32;
+
+        return h;
+}
+
+/**
+ * @brief Strip the line ending off a window line, so that lines read from
+ *        the buffer and from the file hash the same.
+ *
+ * @param line Line, modified in place
+ *
+ * @return line
+ */
+static gchar *line_chomp(gchar *line)
+{
+        gsize len;
+
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+                line[--len] = '\0';
+
+        return line;
+}
+
+/**
+ * @brief Collect the head and tail window lines of a document from the
+ *        editor.  Main thread only.
+ *
+ * @param doc Document
+ *
+ * @return NULL terminated lines, free with g_strfreev()
+ */
+static gchar **window_from_buffer(GeanyDocument *doc)
+{
+        ScintillaObject *sci;
+        GPtrArray *lines;
+        guint n, line;
+
+        sci = doc->editor->sci;
+        n = ml_sci_get_line_count(sci);
+        lines = g_ptr_array_sized_new(MIN(n, 2 * ML_SCAN_LINES) + 1);
+
+        for (line = 0; line < n; line++) {
+                // Jump from the head window to the tail window
+                if (line == ML_SCAN_LINES && n > 2 * ML_SCAN_LINES)
+                        line = n - ML_SCAN_LINES;
+
+                g_ptr_array_add(lines, line_chomp(ml_sci_get_line(sci, line)));
+        }
+        g_ptr_array_add(lines, NULL);
+
+        return (gchar **) g_ptr_array_free(lines, FALSE);
+}
+
+/**
+ * @brief Collect the head and tail window lines of a file from its first and
+ *        last ML_WINDOW_BYTES bytes, without touching the Scintilla buffer.
+ *        Safe to call from any thread.
+ *
+ * Only whole lines are kept: the line cut off at the end of the head window
+ * and at the start of the tail window are dropped.
+ *
+ * @param path Locale encoded file name
+ *
+ * @return NULL terminated lines, free with g_strfreev(); NULL if the file
+ *         could not be read
+ */
+static gchar **window_from_file(const gchar *path)
+{
+        gchar head[ML_WINDOW_BYTES + 1], tail[ML_WINDOW_BYTES + 1];
+        gchar **split, *start;
+        GPtrArray *lines;
+        struct stat sb;
+        ssize_t hlen, tlen;
+        off_t toff;
+        guint n, line;
+        gboolean head_eol;
+        int fd;
+
+        if ((fd = open(path, O_RDONLY)) < 0)
+                return NULL;
+
+        if (fstat(fd, &sb) < 0 || (hlen = pread(fd, head, ML_WINDOW_BYTES, 0)) < 0) {
+                close(fd);
+                return NULL;
+        }
+
+        toff = MAX((off_t) hlen, sb.st_size - ML_WINDOW_BYTES);
+        tlen = (toff < sb.st_size) ? pread(fd, tail, sb.st_size - toff, toff) : 0;
+        close(fd);
+
+        lines = g_ptr_array_sized_new(2 * ML_SCAN_LINES + 1);
+
+        head[hlen] = '\0';
+        head_eol = hlen > 0 && head[hlen - 1] == '\n';
+        if (hlen < sb.st_size && (start = strrchr(head, '\n')))
+                *start = '\0';
+
+        split = g_strsplit(head, "\n", ML_SCAN_LINES + 1);
+        for (line = 0; split[line] && line < ML_SCAN_LINES; line++)
+                g_ptr_array_add(lines, line_chomp(g_strdup(split[line])));
+        g_strfreev(split);
+
+        if (tlen > 0) {
+                tail[tlen] = '\0';
+                start = tail;
+                if ((toff > hlen || !head_eol) && (start = strchr(tail, '\n')))
+                        start++;
+
+                if (start) {
+                        split = g_strsplit(start, "\n", -1);
+                        n = g_strv_length(split);
+                        for (line = (n > ML_SCAN_LINES) ? n - ML_SCAN_LINES : 0; line < n; line++)
+                                g_ptr_array_add(lines, line_chomp(g_strdup(split[line])));
+                        g_strfreev(split);
+                }
+        }
+        g_ptr_array_add(lines, NULL);
+
+        return (gchar **) g_ptr_array_free(lines, FALSE);
+}
+
+/**
+ * @brief Collect what a modeline may follow in a filetype: a comment token,
+ *        or, with C style block comments, the start of a line continuing
+ *        one, as in
+ *
+ *          /\*
+ *           * vim: ts=8
+ *           *\/
+ *
+ * @param ft Filetype, may be NULL
+ *
+ * @return Comments, free with comments_free(), or NULL if the filetype has
+ *         no comments and every line is a candidate
+ */
+static struct ml_comments *comments_new(GeanyFiletype *ft)
+{
+        struct ml_comments *comments;
+        GPtrArray *toks;
+
+        if (!ft)
+                return NULL;
+
+        toks = g_ptr_array_new();
+        if (ft->comment_single && *ft->comment_single)
+                g_ptr_array_add(toks, g_strdup(ft->comment_single));
+        if (ft->comment_open && *ft->comment_open)
+                g_ptr_array_add(toks, g_strdup(ft->comment_open));
+
+        if (!toks->len) {
+                g_ptr_array_free(toks, TRUE);
+                return NULL;
+        }
+        g_ptr_array_add(toks, NULL);
+
+        comments = g_slice_new0(struct ml_comments);
+        comments->tokens = (gchar **) g_ptr_array_free(toks, FALSE);
+
+        comments->star_lines = !g_strcmp0(ft->comment_open, "/*");
+
+        return comments;
+}
+
+/**
+ * @brief Free comments
+ *
+ * @param comments Comments, may be NULL
+ */
+static void comments_free(struct ml_comments *comments)
+{
+        if (!comments)
+                return;
+
+        g_strfreev(comments->tokens);
+        g_slice_free(struct ml_comments, comments);
+}
+
+/**
+ * @brief Parse the first modeline found in window lines.  Does not touch any
+ *        document, so it is safe to call from any thread.
+ *
+ * @param lines NULL terminated lines, modified in place
+ * @param settings Array to append the parsed settings to
+ * @param comments Comments from comments_new(), or NULL
+ *
+ * @return TRUE if a modeline was found
+ */
+static gboolean parse_window(gchar **lines, GArray *settings, struct ml_comments *comments)
+{
+        guint i;
+
+        for (i = 0; lines[i]; i++) {
+                if (scan_line(lines[i], settings, comments))
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+/**
+ * @brief Switches the document to the None filetype, whose lexer does no
+ *        styling, and drops any styling already done.  As an early option
+ *        this happens before the document is first styled.
+ *
+ * @param doc Document
+ * @param arg Unused
+ */
+static void opt_no_lexer(GeanyDocument *doc, void *arg)
+{
+        GeanyFiletype *none;
+
+        debugf("opt_no_lexer\n");
+
+        none = filetypes_index(GEANY_FILETYPES_NONE);
+        if (doc->file_type != none)
+                ml_document_set_filetype(doc, none);
+
+        ml_sci_send(doc->editor->sci, SCI_CLEARDOCUMENTSTYLE, 0, 0);
+}
+
+/**
+ * @brief Sets the filetype, looked up by Geany name or vim/Emacs alias.
+ *        syntax=off turns lexing off, see opt_no_lexer().
+ *
+ * This is applied before the other options, and from the open hook, before
+ * the document is first styled.
+ *
+ * @param doc Document
+ * @param arg Filetype name (gchar *)
+ */
+static void opt_filetype(GeanyDocument *doc, void *arg)
+{
+        const gchar *str = arg;
+        GeanyFiletype *ft;
+        gchar *key;
+
+        if (!g_ascii_strcasecmp(str, "off")) {
+                opt_no_lexer(doc, NULL);
+                return;
+        }
+
+        key = g_ascii_strdown(str, -1);
+        ft = g_hash_table_lookup(ft_table, key);
+        g_free(key);
+
+        debugf("opt_filetype: \"%s\" -> %s\n", str, ft ? ft->name : "?");
+
+        if (ft && ft != doc->file_type)
+                ml_document_set_filetype(doc, ft);
+}
+
+/**
+ * @brief Whether any line ending in the buffer differs from an EOL mode.
+ *        One memchr() sweep over the text, no per-line calls.
+ *
+ * @param sci Editor
+ * @param mode SC_EOL_LF, SC_EOL_CRLF or SC_EOL_CR
+ *
+ * @return TRUE if converting would change the text
+ */
+static gboolean eols_differ(ScintillaObject *sci, gint mode)
+{
+        const gchar *text, *end, *p;
+        gsize len;
+
+        len = ml_sci_get_length(sci);
+        text = (const gchar *) ml_sci_send(sci, SCI_GETCHARACTERPOINTER, 0, 0);
+        end = text + len;
+
+        switch (mode) {
+        case SC_EOL_LF:
+                return memchr(text, '\r', len) != NULL;
+        case SC_EOL_CR:
+                return memchr(text, '\n', len) != NULL;
+        default:
+                // Every \n must follow a \r, and every \r precede a \n
+                for (p = text; (p = memchr(p, '\n', end - p)); p++) {
+                        if (p == text || p[-1] != '\r')
+                                return TRUE;
+                }
+                for (p = text; (p = memchr(p, '\r', end - p)); p++) {
+                        if (p + 1 == end || p[1] != '\n')
+                                return TRUE;
+                }
+                return FALSE;
+        }
+}
+
+/**
+ * @brief Sets the line ending mode, converting existing line endings in one
+ *        undoable step if any of them differ.
+ *
+ * @param doc Document
+ * @param arg Index into ff_choices (gint)
+ */
+static void opt_fileformat(GeanyDocument *doc, void *arg)
+{
+        static const gint eol_modes[] = { SC_EOL_LF, SC_EOL_CRLF, SC_EOL_CR };
+        ScintillaObject *sci;
+        gint *iarg, mode;
+
+        iarg = arg;
+        mode = eol_modes[*iarg];
+
+        debugf("opt_fileformat: %s\n", ff_choices[*iarg]);
+
+        sci = doc->editor->sci;
+        ml_sci_send(sci, SCI_SETEOLMODE, mode, 0);
+
+        if (!eols_differ(sci, mode))
+                return;
+
+        ml_sci_send(sci, SCI_BEGINUNDOACTION, 0, 0);
+        ml_sci_send(sci, SCI_CONVERTEOLS, mode, 0);
+        ml_sci_send(sci, SCI_ENDUNDOACTION, 0, 0);
+}
+
+/**
+ * @brief Sets how much styling is done ahead of what is visible
+ *
+ * @param doc Document
+ * @param arg Index into idle_choices (gint)
+ */
+static void opt_idle_styling(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_idle_styling: %s\n", idle_choices[*iarg]);
+
+#ifdef SCI_SETIDLESTYLING
+        ml_sci_send(doc->editor->sci, SCI_SETIDLESTYLING, *iarg, 0);
+#endif
+}
+
+/**
+ * @brief Sets how many lines' layout is cached
+ *
+ * @param doc Document
+ * @param arg Index into cache_choices (gint)
+ */
+static void opt_layout_cache(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_layout_cache: %s\n", cache_choices[*iarg]);
+
+        ml_sci_send(doc->editor->sci, SCI_SETLAYOUTCACHE, *iarg, 0);
+}
+
+/**
+ * @brief Whether or not to highlight the caret line
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_caret_line(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_caret_line: %d\n", *iarg);
+
+        ml_sci_send(doc->editor->sci, SCI_SETCARETLINEVISIBLE, *iarg, 0);
+}
+
+/**
+ * @brief Whether or not to show white space
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_whitespace(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_whitespace: %d\n", *iarg);
+
+        ml_sci_send(doc->editor->sci, SCI_SETVIEWWS,
+                    (*iarg) ? SCWS_VISIBLEALWAYS : SCWS_INVISIBLE, 0);
+}
+
+/**
+ * @brief Whether or not to show indentation guides
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_indent_guides(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_indent_guides: %d\n", *iarg);
+
+        ml_sci_send(doc->editor->sci, SCI_SETINDENTATIONGUIDES,
+                    (*iarg) ? SC_IV_LOOKBOTH : SC_IV_NONE, 0);
+}
+
+/**
+ * @brief Whether or not to fold.  Without folding the lexer does not compute
+ *        fold levels and the fold margin is hidden.
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_fold_enable(GeanyDocument *doc, void *arg)
+{
+        ScintillaObject *sci;
+        gint *iarg;
+
+        iarg = arg;
+        sci = doc->editor->sci;
+
+        debugf("opt_fold_enable: %d\n", *iarg);
+
+        if (*iarg) {
+                if (!geany_data->editor_prefs->folding)
+                        return;
+                ml_sci_send(sci, SCI_SETPROPERTY, (uptr_t) "fold", (sptr_t) "1");
+                ml_sci_send(sci, SCI_SETMARGINWIDTHN, ML_FOLD_MARGIN, ML_FOLD_MARGIN_WIDTH);
+        } else {
+                ml_state_get(doc)->fold_pending = 0;
+
+                // Nothing may stay hidden once the margin is gone
+                ml_sci_send(sci, SCI_FOLDALL, SC_FOLDACTION_EXPAND, 0);
+                ml_sci_send(sci, SCI_SETPROPERTY, (uptr_t) "fold", (sptr_t) "0");
+                ml_sci_send(sci, SCI_SETMARGINWIDTHN, ML_FOLD_MARGIN, 0);
+        }
+}
+
+/**
+ * @brief Close the folds of a pending foldlevel in the text styled so far.
+ *
+ * Fold levels are only known once the lexer has been over the text, and
+ * forcing it over the whole document would lex a huge file in one go, so this
+ * runs again after each paint until the end is reached.  A fold is only
+ * closed once all of it is styled: lines styled after their header was closed
+ * would stay visible.
+ *
+ * @param doc Document
+ * @param st State of the document, with fold_pending set
+ */
+static void fold_level_apply(GeanyDocument *doc, struct ml_state *st)
+{
+        ScintillaObject *sci;
+        gint lines, styled, line, level, last;
+
+        sci = doc->editor->sci;
+        lines = ml_sci_get_line_count(sci);
+
+        // Lines before this one are styled completely
+        styled = ml_sci_send(sci, SCI_GETENDSTYLED, 0, 0);
+        styled = (styled >= ml_sci_get_length(sci)) ? lines : ml_sci_send(sci, SCI_LINEFROMPOSITION, styled, 0);
+
+        for (line = st->fold_line; line < styled; line++) {
+                level = ml_sci_send(sci, SCI_GETFOLDLEVEL, line, 0);
+                if (!(level & SC_FOLDLEVELHEADERFLAG) ||
+                    (level & SC_FOLDLEVELNUMBERMASK) - SC_FOLDLEVELBASE < st->fold_level)
+                        continue;
+
+                // The fold may go on past the styled text, wait for it
+                last = ml_sci_send(sci, SCI_GETLASTCHILD, line, -1);
+                if (styled < lines && last >= styled - 1)
+                        break;
+
+                ml_sci_send(sci, SCI_FOLDLINE, line, SC_FOLDACTION_CONTRACT);
+                line = MAX(line, last);
+        }
+
+        st->fold_line = line;
+        if (line >= lines)
+                st->fold_pending = 0;
+}
+
+/**
+ * @brief Close folds deeper than a level, like vim's foldlevel.
+ *
+ * Does nothing when folding is off for the document.  The folds are closed by
+ * fold_level_apply() as the text gets styled, the document is never lexed
+ * from here.
+ *
+ * @param doc Document
+ * @param arg Fold level (gint)
+ */
+static void opt_fold_level(GeanyDocument *doc, void *arg)
+{
+        ScintillaObject *sci;
+        struct ml_state *st;
+        gint *iarg;
+
+        iarg = arg;
+        sci = doc->editor->sci;
+
+        debugf("opt_fold_level: %d\n", *iarg);
+
+        // Folding is off for the document, e.g. nofoldenable or the large file profile
+        if (!geany_data->editor_prefs->folding ||
+            !ml_sci_send(sci, SCI_GETPROPERTYINT, (uptr_t) "fold", 0))
+                return;
+
+        st = ml_state_get(doc);
+        st->fold_level = *iarg;
+        st->fold_line = 0;
+        st->fold_pending = 1;
+
+        fold_level_apply(doc, st);
+}
+
+/**
+ * @brief Whether or not the document is read-only
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_readonly(GeanyDocument *doc, void *arg)
+{
+        gint *iarg;
+
+        iarg = arg;
+
+        debugf("opt_readonly: %d\n", *iarg);
+
+        if (doc->readonly == !!(*iarg))
+                return;
+
+        doc->readonly = !!(*iarg);
+        ml_sci_set_readonly(doc->editor->sci, doc->readonly);
+        // Refreshes the tab label to show the read-only state
+        ml_document_set_text_changed(doc, doc->changed);
+}
+
+/**
+ * @brief Whether or not the document may be changed, the opposite of
+ *        opt_readonly()
+ *
+ * @param doc Document
+ * @param arg 1/0 (gint)
+ */
+static void opt_modifiable(GeanyDocument *doc, void *arg)
+{
+        gint *iarg, ro;
+
+        iarg = arg;
+        ro = !(*iarg);
+
+        opt_readonly(doc, &ro);
+}
+
+/**
+ * @brief Turns undo history off for a negative number of levels, which keeps
+ *        generated files from collecting undo memory.  Scintilla has no limit
+ *        on levels, any other value turns it back on.
+ *
+ * @param doc Document
+ * @param arg Undo levels (gint)
+ */
+static void opt_undo_levels(GeanyDocument *doc, void *arg)
+{
+        ScintillaObject *sci;
+        gint *iarg;
+
+        iarg = arg;
+        sci = doc->editor->sci;
+
+        debugf("opt_undo_levels: %d\n", *iarg);
+
+        if (*iarg < 0) {
+                ml_sci_send(sci, SCI_SETUNDOCOLLECTION, 0, 0);
+                ml_sci_send(sci, SCI_EMPTYUNDOBUFFER, 0, 0);
+        } else {
+                ml_sci_send(sci, SCI_SETUNDOCOLLECTION, 1, 0);
+        }
+}
+
+/**
+ * @brief Find where the first comment starts in a line.
+ *
+ * @param buf Line, without leading white space
+ * @param comments Comments
+ *
+ * @return Start of the earliest comment token, the line itself if it
+ *         continues a block comment, NULL if there is no comment
+ */
+static gchar *comment_start(gchar *buf, struct ml_comments *comments)
+{
+        gchar *p, *first = NULL;
+        guint i;
+
+        // Not "*p = ...", a dereference in C
+        if (comments->star_lines && buf[0] == '*' && g_ascii_isspace(buf[1]))
+                return buf;
+
+        for (i = 0; comments->tokens[i]; i++) {
+                p = strstr(buf, comments->tokens[i]);
+                if (p && (!first || p < first))
+                        first = p;
+        }
+
+        return first;
+}
+
+/**
+ * @brief Check one line for a modeline prefix and parse it if there is one.
+ *        With comments, the prefix must follow a comment start or be on a
+ *        line continuing a block comment; other lines are skipped before
+ *        any prefix search.
+ *
+ * @param buf Line, modified in place
+ * @param settings Array to append the parsed settings to
+ * @param comments Comments from comments_new(), or NULL
+ *
+ * @return TRUE if the line was a modeline
+ */
+static gboolean scan_line(gchar *buf, GArray *settings, struct ml_comments *comments)
+{
+        gchar *pre;
+        guint i;
+
+        buf = g_strstrip(buf);
+
+        if (comments && !(buf = comment_start(buf, comments)))
+                return FALSE;
+
+        for (i = 0; mode_pre[i] != NULL; i++) {
+                if ((pre = strstr(buf, mode_pre[i]))) {
+                        parse_options(pre + strlen(mode_pre[i]), settings,
+                                      !strcmp(mode_pre[i], GEANY_PREFIX));
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * @brief Build the filetype lookup table from Geany's filetypes and the
+ *        vim/Emacs aliases.
+ */
+static void ft_table_build(void)
+{
+        GeanyFiletype *ft;
+        guint i;
+
+        ft_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+        for (i = 0; i < filetypes_array->len; i++) {
+                ft = g_ptr_array_index(filetypes_array, i);
+                g_hash_table_insert(ft_table, g_ascii_strdown(ft->name, -1), ft);
+        }
+
+        for (i = 0; ft_aliases[i].alias; i++) {
+                if ((ft = filetypes_lookup_by_name(ft_aliases[i].name)))
+                        g_hash_table_replace(ft_table, g_strdup(ft_aliases[i].alias), ft);
+        }
+}
+
+/**
+ * @brief Remember where the head and tail windows of a document are in the
+ *        buffer, so that edits can be matched against them cheaply.
+ *
+ * @param doc Document
+ */
+static void window_track(GeanyDocument *doc)
+{
+        ScintillaObject *sci;
+        struct ml_state *st;
+        gint n;
+
+        sci = doc->editor->sci;
+        st = ml_state_get(doc);
+        n = ml_sci_get_line_count(sci);
+
+        st->head_end = ml_sci_get_position_from_line(sci, MIN(n, ML_SCAN_LINES));
+        st->tail_start = (n > ML_SCAN_LINES) ? ml_sci_get_position_from_line(sci, n - ML_SCAN_LINES) : 0;
+        st->tracked = 1;
+}
+
+/**
+ * @brief Parse and apply window lines, unless they hash the same as the
+ *        ones applied last.
+ *
+ * @param doc Document
+ * @param lines NULL terminated lines, modified in place
+ *
+ * @return Parsed settings, NULL if the windows were unchanged
+ */
+static GArray *scan_lines(GeanyDocument *doc, gchar **lines)
+{
+        struct ml_state *st;
+        GArray *settings;
+        struct ml_comments *comments;
+        guint64 hash;
+        gsize bytes;
+
+        hash = window_hash(lines, &bytes);
+        counters[ML_COUNT_SCANNED]++;
+        counters[ML_COUNT_BYTES] += bytes;
+
+        // Same windows as last time, everything is applied already
+        st = ml_state_get(doc);
+        if (st->has_hash && st->window_hash == hash)
+                return NULL;
+        st->window_hash = hash;
+        st->has_hash = 1;
+
+        settings = settings_new();
+        comments = comments_new(doc->file_type);
+        if (parse_window(lines, settings, comments))  // Left empty if there is no modeline
+                counters[ML_COUNT_FOUND]++;
+        comments_free(comments);
+        apply_document(doc, settings);
+
+        return settings;
+}
+
+/**
+ * @brief Free a scan
+ *
+ * @param scan Scan
+ */
+static void scan_free(struct ml_scan *scan)
+{
+        g_free(scan->old_enc);
+        g_ptr_array_free(scan->lines, TRUE);
+        g_strfreev(scan->file_lines);
+        g_slice_free(struct ml_scan, scan);
+}
+
+/**
+ * @brief Cleanup: free an unfinished scan, or leave it to its read callback.
+ *
+ * @param key
+ * @param value Scan (struct ml_scan *)
+ * @param user_data
+ */
+static void scan_drop(gpointer key, gpointer value, gpointer user_data)
+{
+        struct ml_scan *scan = value;
+
+        if (scan->reading)
+                scan->cancelled = TRUE;
+        else
+                scan_free(scan);
+}
+
+/**
+ * @brief Drop the unfinished scan of a document, if there is one.
+ *
+ * @param doc_id doc->id
+ */
+static void scan_cancel(guint doc_id)
+{
+        struct ml_scan *scan;
+
+        if (!(scan = g_hash_table_lookup(scans, GUINT_TO_POINTER(doc_id))))
+                return;
+        g_hash_table_remove(scans, GUINT_TO_POINTER(doc_id));
+
+        // The read callback owns it until the worker is done
+        if (scan->reading) {
+                scan->cancelled = TRUE;
+                return;
+        }
+
+        g_queue_remove(&scan_queue, scan);
+        scan_free(scan);
+}
+
+/**
+ * @brief Parse and apply the windows of a scan that has read them all, then
+ *        do what the hook that started it waits for.
+ *
+ * @param doc Document
+ * @param scan Scan, freed
+ */
+static void scan_finish(GeanyDocument *doc, struct ml_scan *scan)
+{
+        GArray *settings;
+        gchar **lines;
+
+        g_hash_table_remove(scans, GUINT_TO_POINTER(scan->doc_id));
+
+        g_ptr_array_add(scan->lines, NULL);
+        lines = scan->file_lines ? scan->file_lines : (gchar **) scan->lines->pdata;
+        settings = scan_lines(doc, lines);
+
+        // Only what is saved may be cached for the file
+        if (settings)
+                cache_store(doc->changed ? NULL : doc->real_path, settings,
+                            ml_state_get(doc)->window_hash);
+
+        if (scan->flags & ML_SCAN_OPEN)
+                reload_if_needed(doc, scan->old_enc);
+        if (scan->flags & ML_SCAN_SAVE)
+                ml_state_get(doc)->need_reload = 0;  // The new encoding is used from now on
+
+        trace_event(scan->flags, doc, scan->start);
+        scan_free(scan);
+}
+
+/**
+ * @brief Read buffer lines of a scan's windows until the deadline.  Also
+ *        finishes the scan once everything is read.
+ *
+ * @param doc Document
+ * @param scan Scan
+ * @param deadline g_get_monotonic_time() to stop at
+ *
+ * @return TRUE if the scan is finished and freed
+ */
+static gboolean scan_step(GeanyDocument *doc, struct ml_scan *scan, gint64 deadline)
+{
+        ScintillaObject *sci;
+
+        sci = doc->editor->sci;
+
+        // Lines may have gone since the scan started, the live re-scan catches up
+        scan->count = MIN(scan->count, (guint) ml_sci_get_line_count(sci));
+
+        for (; scan->line < scan->count; scan->line++) {
+                if (g_get_monotonic_time() >= deadline)
+                        return FALSE;
+
+                // Jump from the head window to the tail window
+                if (scan->line == ML_SCAN_LINES && scan->count > 2 * ML_SCAN_LINES)
+                        scan->line = scan->count - ML_SCAN_LINES;
+
+                g_ptr_array_add(scan->lines, line_chomp(ml_sci_get_line(sci, scan->line)));
+        }
+
+        scan_finish(doc, scan);
+        return TRUE;
+}
+
+/**
+ * @brief Idle: give unfinished scans one slice of ML_SLICE_BUDGET.
+ *
+ * @param data
+ *
+ * @return G_SOURCE_CONTINUE while scans are waiting
+ */
+static gboolean scan_run(gpointer data)
+{
+        struct ml_scan *scan;
+        GeanyDocument *doc;
+        gint64 start, deadline;
+
+        start = g_get_monotonic_time();
+        deadline = start + ML_SLICE_BUDGET;
+
+        while ((scan = g_queue_peek_head(&scan_queue)) && g_get_monotonic_time() < deadline) {
+                // Document close cancels its scan, but do not rely on it
+                if (!(doc = document_find_by_id(scan->doc_id))) {
+                        g_queue_pop_head(&scan_queue);
+                        g_hash_table_remove(scans, GUINT_TO_POINTER(scan->doc_id));
+                        scan_free(scan);
+                        continue;
+                }
+
+                if (scan_step(doc, scan, deadline))
+                        g_queue_pop_head(&scan_queue);
+        }
+
+        counters_time(start);
+
+        if (g_queue_is_empty(&scan_queue)) {
+                scan_source = 0;
+                return G_SOURCE_REMOVE;
+        }
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Queue a scan for the next slices.
+ *
+ * @param scan Scan
+ */
+static void scan_queue_push(struct ml_scan *scan)
+{
+        g_queue_push_tail(&scan_queue, scan);
+        if (!scan_source)
+                scan_source = g_idle_add(scan_run, NULL);
+}
+
+/**
+ * @brief Worker thread: read the windows of a large document from its file.
+ *
+ * @param task
+ * @param source
+ * @param data Path (gchar *)
+ * @param cancellable
+ */
+static void scan_read_thread(GTask *task, gpointer source, gpointer data,
+                             GCancellable *cancellable)
+{
+        g_task_return_pointer(task, window_from_file(data), (GDestroyNotify) g_strfreev);
+}
+
+/**
+ * @brief Main loop: the windows of a large document were read, finish its
+ *        scan, or fall back to reading the buffer in slices.
+ *
+ * @param source
+ * @param res
+ * @param user_data Scan (struct ml_scan *)
+ */
+static void scan_read_done(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        struct ml_scan *scan = user_data;
+        GeanyDocument *doc;
+
+        scan->file_lines = g_task_propagate_pointer(G_TASK(res), NULL);
+        scan->reading = FALSE;
+
+        // Replaced, closed, or the plugin was unloaded
+        if (scan->cancelled) {
+                scan_free(scan);
+                return;
+        }
+
+        if (!(doc = document_find_by_id(scan->doc_id))) {
+                g_hash_table_remove(scans, GUINT_TO_POINTER(scan->doc_id));
+                scan_free(scan);
+                return;
+        }
+
+        if (scan->file_lines) {
+                scan_finish(doc, scan);
+        } else {
+                debugf("scan: cannot read %s, using the buffer\n", doc->real_path);
+                scan_queue_push(scan);
+        }
+}
+
+/**
+ * @brief Scan a document, line by line, looking for modelines in the first
+ *        and last ML_SCAN_LINES lines, and apply what is found.
+ *
+ * The scan gets ML_SLICE_BUDGET in the calling hook, which is enough for
+ * ordinary documents; the rest is read in idle slices.  Documents above
+ * large_file_size have their windows read from disk, unless they have unsaved
+ * changes: by a worker, except on open, where early options must be applied
+ * before the document is first styled and the two ML_WINDOW_BYTES reads are
+ * done in the hook.
+ *
+ * @param doc Document
+ * @param flags enum ml_scan_flag
+ */
+static void scan_document(GeanyDocument *doc, guint flags)
+{
+        struct ml_scan *scan, *old;
+        struct ml_state *st;
+        GArray *settings;
+        GTask *task;
+        gchar *old_enc = NULL;
+        guint64 hash;
+        gint64 start, deadline;
+
+        start = g_get_monotonic_time();
+        deadline = start + ML_SLICE_BUDGET;
+
+        if (!doc->is_valid)
+                return;
+
+        // Replace an unfinished scan, and do what it was started for.  The
+        // trace counts the time from the replaced scan's event.
+        if ((old = g_hash_table_lookup(scans, GUINT_TO_POINTER(doc->id)))) {
+                flags |= old->flags & (ML_SCAN_OPEN | ML_SCAN_SAVE);
+                old_enc = old->old_enc;
+                old->old_enc = NULL;
+                if (old->flags & (ML_SCAN_OPEN | ML_SCAN_SAVE))
+                        start = old->start;
+                scan_cancel(doc->id);
+        }
+        if ((flags & ML_SCAN_OPEN) && !old_enc)
+                old_enc = g_strdup(doc->encoding);
+
+        window_track(doc);
+
+        scan = g_slice_new0(struct ml_scan);
+        scan->doc_id = doc->id;
+        scan->flags = flags;
+        scan->old_enc = old_enc;
+        scan->start = start;
+        scan->count = ml_sci_get_line_count(doc->editor->sci);
+        scan->lines = g_ptr_array_new_with_free_func(g_free);
+
+        if ((flags & ML_SCAN_CACHE) && (settings = cache_lookup(doc->real_path, &hash))) {
+                debugf("scan: %s cached\n", doc->real_path);
+                apply_document(doc, settings);
+
+                // The activate scan that follows opening finds nothing new
+                st = ml_state_get(doc);
+                st->window_hash = hash;
+                st->has_hash = 1;
+
+                if (flags & ML_SCAN_OPEN)
+                        reload_if_needed(doc, scan->old_enc);
+                trace_event(flags, doc, start);
+                scan_free(scan);
+                return;
+        }
+
+        g_hash_table_insert(scans, GUINT_TO_POINTER(doc->id), scan);
+
+        // Unsaved edits are only in the buffer
+        if (doc->real_path && !doc->changed && ml_sci_get_length(doc->editor->sci) > large_file_size) {
+                // Early options must land before the document is first styled:
+                // on open, read the two bounded windows right here
+                if ((flags & ML_SCAN_OPEN) && (scan->file_lines = window_from_file(doc->real_path))) {
+                        scan_finish(doc, scan);
+                        return;
+                }
+
+                scan->reading = TRUE;
+                task = g_task_new(NULL, NULL, scan_read_done, scan);
+                g_task_set_task_data(task, g_strdup(doc->real_path), g_free);
+                g_task_run_in_thread(task, scan_read_thread);
+                g_object_unref(task);
+                return;
+        }
+
+        if (!scan_step(doc, scan, deadline))
+                scan_queue_push(scan);
+}
+
+/**
+ * @brief Debounce timer: re-scan the documents whose windows were edited.
+ *        The buffer is scanned even for large documents, the file on disk
+ *        does not have the edits yet.
+ *
+ * @param data
+ *
+ * @return G_SOURCE_REMOVE
+ */
+static gboolean live_rescan(gpointer data)
+{
+        GHashTableIter iter;
+        GeanyDocument *doc;
+        GArray *settings;
+        gpointer id;
+        gchar **lines;
+        gint64 start;
+
+        start = g_get_monotonic_time();
+        live_source = 0;
+
+        g_hash_table_iter_init(&iter, live_dirty);
+        while (g_hash_table_iter_next(&iter, &id, NULL)) {
+                if (!(doc = document_find_by_id(GPOINTER_TO_UINT(id))))
+                        continue;
+
+                debugf("live: rescanning document %u\n", doc->id);
+
+                window_track(doc);
+                lines = window_from_buffer(doc);
+                if ((settings = scan_lines(doc, lines)))
+                        g_array_free(settings, TRUE);
+                g_strfreev(lines);
+        }
+        g_hash_table_remove_all(live_dirty);
+
+        counters_time(start);
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Parse out each key/value pair from a modeline, then send the pair out
+ *        to the option interpreter.
+ *
+ * @param buf Options, the text after the modeline prefix
+ * @param settings Array to append the parsed settings to
+ * @param geany_ns Whether this is a geany: modeline
+ */
+static void parse_options(gchar *buf, GArray *settings, gboolean geany_ns)
+{
+        gchar **tok;
+        guint i;
+
+        debugf("modeline [%s]\n", buf);
+
+        // XXX Spaces not allowed around = character...
+        // Can be separated by colon, space and comma
+        tok = g_strsplit_set(buf, ": ,", 0);
+        for (i = 0; tok[i]; i++) {
+                if (*tok[i])  // Skip empty parts
+                        interpret_option(tok[i], settings, geany_ns);
+        }
+        g_strfreev(tok);
+}
+
+/**
+ * @brief Interpret an option and queue it for setting.
+ *
+ * @param opt Key/value pair
+ * @param settings Array to append the parsed setting to
+ * @param geany_ns Whether this is a geany: modeline
+ */
+static void interpret_option(gchar *opt, GArray *settings, gboolean geany_ns)
+{
+        struct ml_setting set = { NULL, 0, NULL };
+        gchar **kv, *key, *val, *end = NULL;
+        gint64 num = 0;
+        guint i, j;
+
+        debugf("interpret [%s]\n", opt);
+
+        kv = g_strsplit(opt, "=", 2);
+        key = kv[0];
+        val = kv[1];
+        if (!key || !*key || (val && !*val)) {
+                g_strfreev(kv);
+                return;  // Starts or ends with = character
+        }
+
+        for (i = 0; opts[i].name; i++) {
+                // name matched OR alias is not NULL AND mached else skip
+                if (!g_ascii_strcasecmp(opts[i].name, key) ||
+                        (opts[i].alias && !g_ascii_strcasecmp(opts[i].alias, key))) {
+
+                        if ((opts[i].flags & MODE_OPT_GEANY) && !geany_ns) {
+                                debugf("%s needs a geany: modeline\n", opts[i].name);
+                                break;
+                        }
+
+                        set.opt = &opts[i];
+                        switch (opts[i].arg_type) {
+                        case MODE_OPT_ARG_TRUE:
+                                set.iarg = 1;
+                                break;
+                        case MODE_OPT_ARG_FALSE:
+                                set.iarg = 0;
+                                break;
+                        case MODE_OPT_ARG_INT:
+                                // Overflow saturates, so it is clamped as well
+                                if (val)
+                                        num = g_ascii_strtoll(val, &end, 10);
+                                if (!val || end == val || *end) {
+                                        set.opt = NULL;
+                                        break;
+                                }
+                                set.iarg = CLAMP(num, opts[i].min, opts[i].max);
+                                break;
+                        case MODE_OPT_ARG_STR:
+                                if (!val || strlen(val) > (gsize) opts[i].max)
+                                        set.opt = NULL;
+                                else
+                                        set.sarg = g_strdup(val);
+                                break;
+                        case MODE_OPT_ARG_ENUM:
+                                set.opt = NULL;
+                                for (j = 0; val && opts[i].choices[j]; j++) {
+                                        if (!g_ascii_strcasecmp(opts[i].choices[j], val)) {
+                                                set.opt = &opts[i];
+                                                set.iarg = j;
+                                                break;
+                                        }
+                                }
+                                break;
+                        }
+
+                        if (set.opt)
+                                g_array_append_val(settings, set);
+                        else
+                                debugf("invalid value for %s\n", opts[i].name);
+                        break;
+                }
+        }
+
+        g_strfreev(kv);
+}
+
+/**
+ * @brief Free a re-decode job
+ *
+ * @param data Job (struct ml_decode *)
+ */
+static void redecode_free(gpointer data)
+{
+        struct ml_decode *dec = data;
+
+        g_free(dec->path);
+        g_free(dec->charset);
+        g_free(dec->old_charset);
+        g_free(dec->text);
+        g_slice_free(struct ml_decode, dec);
+}
+
+/**
+ * @brief Worker thread: read the file and convert it to UTF-8.
+ *
+ * @param task
+ * @param source
+ * @param data Job (struct ml_decode *)
+ * @param cancellable
+ */
+static void redecode_thread(GTask *task, gpointer source, gpointer data,
+                            GCancellable *cancellable)
+{
+        struct ml_decode *dec = data;
+        GError *err = NULL;
+        gchar *raw;
+        gsize len;
+
+        if (!g_file_get_contents(dec->path, &raw, &len, &err)) {
+                g_task_return_error(task, err);
+                return;
+        }
+
+        dec->text = g_convert(raw, len, "UTF-8", dec->charset, NULL, NULL, &err);
+        g_free(raw);
+        if (!dec->text) {
+                g_task_return_error(task, err);
+                return;
+        }
+
+        // Keep the BOM out of the buffer, Geany writes it back on save
+        if (g_str_has_prefix(dec->text, "\xEF\xBB\xBF")) {
+                dec->has_bom = TRUE;
+                memmove(dec->text, dec->text + 3, strlen(dec->text + 3) + 1);
+        }
+
+        g_task_return_boolean(task, TRUE);
+}
+
+/**
+ * @brief Put a document back into the charset its buffer was decoded with,
+ *        and forget the modeline's encoding so that a later scan tries again.
+ *
+ * @param doc Document, NULL if it was closed
+ * @param dec Job (struct ml_decode *)
+ */
+static void redecode_revert(GeanyDocument *doc, struct ml_decode *dec)
+{
+        struct ml_state *st;
+
+        if (!doc)
+                return;
+
+        ml_document_set_encoding(doc, dec->old_charset);
+        st = ml_state_get(doc);
+        st->encoding = 0;
+        st->has_hash = 0;
+}
+
+/**
+ * @brief Main loop: put the decoded text into the editor in one replacement.
+ *
+ * The replacement is neither undoable nor a modification: the undo buffer is
+ * emptied and the save point set, as after loading the file.
+ *
+ * @param source
+ * @param res
+ * @param user_data
+ */
+static void redecode_done(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        struct ml_decode *dec = g_task_get_task_data(G_TASK(res));
+        ScintillaObject *sci;
+        GeanyDocument *doc;
+        GError *err = NULL;
+        gboolean ro;
+        gint pos;
+
+        doc = document_find_by_id(dec->doc_id);
+
+        if (!g_task_propagate_boolean(G_TASK(res), &err)) {
+                ui_set_statusbar(TRUE, _("Modeline: could not read \"%s\" as %s (%s)"),
+                                 dec->path, dec->charset, err->message);
+                g_error_free(err);
+                redecode_revert(doc, dec);
+                return;
+        }
+
+        // Closed, or edited while we were decoding.  The buffer still holds
+        // text decoded as the old charset, so keep saving it as that.
+        if (!doc || doc->changed) {
+                debugf("redecode: dropped result for document %u\n", dec->doc_id);
+                redecode_revert(doc, dec);
+                return;
+        }
+
+        sci = doc->editor->sci;
+        pos = ml_sci_get_current_position(sci);
+        ro = ml_sci_send(sci, SCI_GETREADONLY, 0, 0);
+
+        ml_sci_send(sci, SCI_SETREADONLY, 0, 0);
+        ml_sci_send(sci, SCI_SETUNDOCOLLECTION, 0, 0);
+        ml_sci_set_text(sci, dec->text);
+        ml_sci_send(sci, SCI_EMPTYUNDOBUFFER, 0, 0);
+        ml_sci_send(sci, SCI_SETUNDOCOLLECTION, 1, 0);
+        ml_sci_send(sci, SCI_SETSAVEPOINT, 0, 0);
+        ml_sci_send(sci, SCI_SETREADONLY, ro, 0);
+        ml_sci_set_current_position(sci, MIN(pos, ml_sci_get_length(sci)), FALSE);
+
+        doc->has_bom = dec->has_bom;
+        ml_document_set_encoding(doc, dec->charset);
+        ml_document_set_text_changed(doc, FALSE);
+}
+
+/**
+ * @brief Re-decode a document from its file in the encoding it is now set to,
+ *        in a worker thread, so that large files do not block the UI.
+ *
+ * @param doc Document
+ * @param old_enc Encoding the document was loaded in
+ */
+static void redecode_async(GeanyDocument *doc, const gchar *old_enc)
+{
+        struct ml_decode *dec;
+        GTask *task;
+
+        dec = g_slice_new0(struct ml_decode);
+        dec->doc_id = doc->id;
+        dec->path = g_strdup(doc->real_path);
+        dec->charset = g_strdup(doc->encoding);
+        dec->old_charset = g_strdup(old_enc);
+
+        debugf("redecode: %s as %s\n", dec->path, dec->charset);
+
+        task = g_task_new(NULL, NULL, redecode_done, NULL);
+        g_task_set_task_data(task, dec, redecode_free);
+        g_task_run_in_thread(task, redecode_thread);
+        g_object_unref(task);
+}
+
+/**
+ * @brief Reload a document if a modeline changed its encoding.  Modified
+ *        documents are not reloaded, the new encoding is used when saving.
+ *
+ * @param doc Document
+ * @param old_enc Encoding the document had before the modeline was applied
+ */
+static void reload_if_needed(GeanyDocument *doc, const gchar *old_enc)
+{
+        struct ml_state *st;
+
+        st = ml_state_get(doc);
+        if (!st->need_reload)
+                return;
+        st->need_reload = 0;
+
+        if (doc->changed) {
+                counters[ML_COUNT_RELOADS_AVOIDED]++;
+                return;
+        }
+        counters[ML_COUNT_RELOADS]++;
+
+        // The modeline set doc->encoding already
+        if (doc->real_path && ml_sci_get_length(doc->editor->sci) > ML_ASYNC_DECODE_SIZE)
+                redecode_async(doc, old_enc);
+        else
+                ml_document_reload_force(doc, doc->encoding);
+}
+
+/**
+ * @brief Free a batch item
+ *
+ * @param data Item (struct ml_batch_item *)
+ */
+static void batch_item_free(gpointer data)
+{
+        struct ml_batch_item *item = data;
+
+        g_free(item->path);
+        g_strfreev(item->lines);
+        comments_free(item->comments);
+        if (item->settings)
+                g_array_free(item->settings, TRUE);
+        g_slice_free(struct ml_batch_item, item);
+}
+
+/**
+ * @brief Idle: apply the parsed settings of a batch, for ML_SLICE_BUDGET per
+ *        dispatch.
+ *
+ * @param data Batch (struct ml_batch *)
+ *
+ * @return G_SOURCE_CONTINUE until every item is applied
+ */
+static gboolean batch_apply(gpointer data)
+{
+        struct ml_batch *batch = data;
+        struct ml_batch_item *item;
+        struct ml_state *st;
+        GeanyDocument *doc;
+        gchar *old_enc;
+        gint64 start, deadline;
+
+        if (batch->cancelled)
+                goto out;
+
+        start = g_get_monotonic_time();
+        deadline = start + ML_SLICE_BUDGET;
+
+        for (; batch->next < batch->items->len; batch->next++) {
+                // Let the UI breathe, continue in the next idle slice
+                if (g_get_monotonic_time() >= deadline) {
+                        counters_time(start);
+                        return G_SOURCE_CONTINUE;
+                }
+
+                item = g_ptr_array_index(batch->items, batch->next);
+
+                // Closed while the batch was running
+                if (!(doc = document_find_by_id(item->doc_id)))
+                        continue;
+
+                // The file could not be read, fall back to the buffer
+                if (!item->cached && !item->lines) {
+                        item->lines = window_from_buffer(doc);
+                        item->hash = window_hash(item->lines, &item->bytes);
+                        item->found = parse_window(item->lines, item->settings, item->comments);
+                }
+
+                if (!item->cached) {
+                        counters[ML_COUNT_SCANNED]++;
+                        counters[ML_COUNT_BYTES] += item->bytes;
+                        if (item->found)
+                                counters[ML_COUNT_FOUND]++;
+
+                }
+
+                st = ml_state_get(doc);
+                st->window_hash = item->hash;
+                st->has_hash = 1;
+
+                old_enc = g_strdup(doc->encoding);
+                apply_document(doc, item->settings);
+                reload_if_needed(doc, old_enc);
+                g_free(old_enc);
+                if (item->found)
+                        batch->applied++;
+
+                window_track(doc);
+
+                if (!item->cached) {
+                        cache_store(doc->changed ? NULL : doc->real_path, item->settings, item->hash);
+                        item->settings = NULL;
+                }
+        }
+
+        ui_progress_bar_stop();
+        ui_set_statusbar(TRUE, _("Modelines applied to %u of %u documents."),
+                         batch->applied, batch->items->len);
+        batch_running = NULL;
+        counters_time(start);
+
+out:
+        g_ptr_array_free(batch->items, TRUE);
+        g_slice_free(struct ml_batch, batch);
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Worker thread: parse the windows of one batch item.  The last item
+ *        to finish hands the batch back to the main loop.
+ *
+ * @param data Item (struct ml_batch_item *)
+ * @param user_data
+ */
+static void batch_parse(gpointer data, gpointer user_data)
+{
+        struct ml_batch_item *item = data;
+        struct ml_batch *batch = item->batch;
+
+        if (item->path)
+                item->lines = window_from_file(item->path);
+        if (item->lines) {
+                item->hash = window_hash(item->lines, &item->bytes);
+                item->found = parse_window(item->lines, item->settings, item->comments);
+        }
+
+        if (g_atomic_int_dec_and_test(&batch->pending))
+                g_idle_add(batch_apply, batch);
+}
+
+/**
+ * @brief Re-apply modelines to every open document.
+ *
+ * Window lines are collected on the main thread, or left to the workers for
+ * documents read from disk; each document is visited once.
+ */
+static void batch_start(void)
+{
+        struct ml_batch_item *item;
+        struct ml_batch *batch;
+        GeanyDocument *doc;
+        GArray *cached;
+        guint i;
+
+        if (batch_running)
+                return;
+
+        batch = g_slice_new0(struct ml_batch);
+        batch->items = g_ptr_array_new_with_free_func(batch_item_free);
+
+        foreach_document(i) {
+                doc = document_index(i);
+                if (ml_skip_document(doc))
+                        continue;
+
+                item = g_slice_new0(struct ml_batch_item);
+                item->doc_id = doc->id;
+                item->batch = batch;
+
+                if (!doc->changed && (cached = cache_lookup(doc->real_path, &item->hash))) {
+                        item->settings = settings_copy(cached);
+                        item->found = item->cached = TRUE;
+                } else {
+                        item->settings = settings_new();
+                        item->comments = comments_new(doc->file_type);
+                        if (doc->real_path && !doc->changed &&
+                            ml_sci_get_length(doc->editor->sci) > large_file_size)
+                                item->path = g_strdup(doc->real_path);
+                        else
+                                item->lines = window_from_buffer(doc);
+                        batch->pending++;
+                }
+
+                g_ptr_array_add(batch->items, item);
+        }
+
+        if (!batch->items->len) {
+                g_ptr_array_free(batch->items, TRUE);
+                g_slice_free(struct ml_batch, batch);
+                return;
+        }
+
+        batch_running = batch;
+        ui_progress_bar_start(_("Applying modelines..."));
+
+        if (!batch->pending) {
+                g_idle_add(batch_apply, batch);
+                return;
+        }
+
+        for (i = 0; i < batch->items->len; i++) {
+                item = g_ptr_array_index(batch->items, i);
+                if (!item->cached)
+                        g_thread_pool_push(parse_pool, item, NULL);
+        }
+}
+
+/**
+ * @brief Tools menu callback
+ *
+ * @param item
+ * @param user_data
+ */
+static void on_apply_all_activate(GtkWidget *item, gpointer user_data)
+{
+        batch_start();
+}
+
+/**
+ * @brief Document open hook
+ *
+ * @param obj
+ * @param doc Document
+ * @param user_data
+ */
+static void on_document_open(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+        gint64 start = g_get_monotonic_time();
+
+        // The trace line is written when the scan is done
+        if (!ml_skip_document(doc))
+                scan_document(doc, ML_SCAN_CACHE | ML_SCAN_OPEN);
+        else
+                trace_event(ML_SCAN_OPEN, doc, start);
+
+        counters_time(start);
+}
+
+/**
+ * @brief Document save hook
+ *
+ * @param obj
+ * @param doc Document
+ * @param user_data
+ */
+static void on_document_save(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+        gint64 start = g_get_monotonic_time();
+
+        if (!ml_skip_document(doc))
+                // The buffer is already right, the new encoding is used from now on
+                scan_document(doc, ML_SCAN_SAVE);
+        else
+                trace_event(ML_SCAN_SAVE, doc, start);
+
+        counters_time(start);
+}
+
+/**
+ * @brief Document reload hook
+ *
+ * @param obj
+ * @param doc Document
+ * @param user_data
+ */
+static void on_document_reload(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+        gint64 start = g_get_monotonic_time();
+
+        if (!ml_skip_document(doc))
+                scan_document(doc, 0);
+
+        counters_time(start);
+}
+
+/**
+ * @brief Document activate hook, picks up modelines edited since the last
+ *        save.  Cheap when nothing changed, the windows are only hashed.
+ *
+ * @param obj
+ * @param doc Document
+ * @param user_data
+ */
+static void on_document_activate(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+        gint64 start = g_get_monotonic_time();
+
+        if (!ml_skip_document(doc))
+                scan_document(doc, 0);
+
+        counters_time(start);
+}
+
+/**
+ * @brief Document close hook, frees the state slot for reuse
+ *
+ * @param obj
+ * @param doc Document
+ * @param user_data
+ */
+static void on_document_close(GObject *obj, GeanyDocument *doc, gpointer user_data)
+{
+        gint64 start = g_get_monotonic_time();
+
+        scan_cancel(doc->id);
+        ml_state_clear(doc);
+
+        counters_time(start);
+}
+
+/**
+ * @brief Editor notification hook: watch for edits inside the head and tail
+ *        windows and re-scan them shortly after typing stops.
+ *
+ * Runs on every modification, so it only does a few comparisons.  Edits
+ * between the windows move the tail window and nothing else.
+ *
+ * @param obj
+ * @param editor Editor
+ * @param nt Notification
+ * @param user_data
+ *
+ * @return FALSE, to let others see the notification
+ */
+static gboolean on_editor_notify(GObject *obj, GeanyEditor *editor, SCNotification *nt,
+                                 gpointer user_data)
+{
+        struct ml_state *st;
+        gint64 start;
+        gint delta;
+
+        // More text was styled, close the folds of a pending foldlevel in it
+        if (nt->nmhdr.code == SCN_PAINTED) {
+                if ((st = ml_state_peek(editor->document)) && st->fold_pending) {
+                        start = g_get_monotonic_time();
+                        fold_level_apply(editor->document, st);
+                        counters_time(start);
+                }
+                return FALSE;
+        }
+
+        if (nt->nmhdr.code != SCN_MODIFIED ||
+            !(nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+                return FALSE;
+
+        start = g_get_monotonic_time();
+
+        if (!(st = ml_state_peek(editor->document)) || !st->tracked)
+                goto out;
+
+        delta = (nt->modificationType & SC_MOD_INSERTTEXT) ? nt->length : -nt->length;
+
+        if (nt->position < st->head_end || nt->position + nt->length >= st->tail_start) {
+                g_hash_table_add(live_dirty, GUINT_TO_POINTER(st->doc_id));
+                if (live_source)
+                        g_source_remove(live_source);
+                live_source = g_timeout_add(ML_LIVE_DELAY, live_rescan, NULL);
+        }
+
+        if (nt->position < st->tail_start)
+                st->tail_start += delta;
+
+out:
+        counters_time(start);
+        return FALSE;
+}
+
+/**
+ * @brief Plugin initialization
+ *
+ * @param plugin
+ * @param data
+ */
+static gboolean MLplugin_init(GeanyPlugin *plugin, gpointer data)
+{
+        gchar *profile;
+        guint i;
+
+        geany_plugin = plugin;
+        geany_data = plugin->geany_data;
+
+        // Re-decode threads may outlive the plugin being disabled
+        plugin_module_make_resident(plugin);
+
+        ml_states = g_array_sized_new(FALSE, TRUE, sizeof(struct ml_state), 64);
+
+        enc_table = g_hash_table_new(g_str_hash, g_str_equal);
+        for (i = 0; enc_aliases[i].alias; i++)
+                g_hash_table_insert(enc_table, (gpointer) enc_aliases[i].alias,
+                                    GUINT_TO_POINTER(g_quark_from_static_string(enc_aliases[i].charset)));
+
+        ml_load_config();
+        ft_table_build();
+        counters_load();
+        trace_open();
+        counters_source = g_timeout_add_seconds(ML_COUNTERS_INTERVAL, counters_tick, NULL);
+
+        profile = g_strdup(ML_LARGE_FILE_PROFILE);
+        profile_settings = settings_new();
+        parse_options(profile, profile_settings, TRUE);
+        g_free(profile);
+
+        dir_watches = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, dir_watch_free);
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, cache_entry_free);
+        live_dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+        scans = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        parse_pool = g_thread_pool_new(batch_parse, NULL, g_get_num_processors(), FALSE, NULL);
+
+        apply_all_item = gtk_menu_item_new_with_mnemonic(_("Apply _Modelines to All Documents"));
+        gtk_widget_show(apply_all_item);
+        gtk_container_add(GTK_CONTAINER(geany_data->main_widgets->tools_menu), apply_all_item);
+        g_signal_connect(apply_all_item, "activate", G_CALLBACK(on_apply_all_activate), NULL);
+        ui_add_document_sensitive(apply_all_item);
+
+        // Enabled mid-session: catch up on the documents already open
+        batch_start();
+        return TRUE;
+}
+
+/**
+ * @brief Plugin cleanup
+ *
+ * @param plugin
+ * @param data
+ */
+static void MLplugin_cleanup(GeanyPlugin *plugin, gpointer data)
+{
+        gtk_widget_destroy(apply_all_item);
+        apply_all_item = NULL;
+
+        g_source_remove(counters_source);
+        counters_source = 0;
+        counters_save();
+
+        if (trace_file)
+                fclose(trace_file);
+        trace_file = NULL;
+
+        // Let queued items finish; a pending batch frees itself unapplied
+        g_thread_pool_free(parse_pool, FALSE, TRUE);
+        parse_pool = NULL;
+        if (batch_running) {
+                batch_running->cancelled = TRUE;
+                batch_running = NULL;
+                ui_progress_bar_stop();
+        }
+
+        // Scans being read are freed by their callbacks
+        if (scan_source)
+                g_source_remove(scan_source);
+        scan_source = 0;
+        g_hash_table_foreach(scans, scan_drop, NULL);
+        g_hash_table_destroy(scans);
+        scans = NULL;
+        g_queue_clear(&scan_queue);
+
+        if (live_source)
+                g_source_remove(live_source);
+        live_source = 0;
+        g_hash_table_destroy(live_dirty);
+        live_dirty = NULL;
+
+        // Entries release their directory watches
+        g_hash_table_destroy(cache);
+        cache = NULL;
+        g_hash_table_destroy(dir_watches);
+        dir_watches = NULL;
+
+        g_array_free(ml_states, TRUE);
+        ml_states = NULL;
+        g_hash_table_destroy(enc_table);
+        enc_table = NULL;
+        g_hash_table_destroy(ft_table);
+        ft_table = NULL;
+        g_array_free(profile_settings, TRUE);
+        profile_settings = NULL;
+        g_ptr_array_free(skip_paths, TRUE);
+        skip_paths = NULL;
+        g_free(skip_filetypes);
+        skip_filetypes = NULL;
 }
 
 G_MODULE_EXPORT